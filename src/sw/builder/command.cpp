@@ -28,6 +28,7 @@
 #include "os.h"
 //#include "program.h"
 #include "sw_context.h"
+#include "time_trace.h"
 
 #include <sw/manager/settings.h>
 #include <sw/support/filesystem.h>
@@ -41,9 +42,37 @@
 #include <primitives/symbol.h>
 #include <primitives/templates.h>
 #include <primitives/sw/settings_program_name.h>
+#include <nlohmann/json.hpp>
 #include <pystring.h>
 
+#include <fstream>
 #include <regex>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+extern char **environ;
+#endif
 
 #include <primitives/log.h>
 DECLARE_STATIC_LOGGER(logger, "command");
@@ -208,6 +237,387 @@ CommandNode::~CommandNode()
 {
 }
 
+static int64_t getDefaultMemoryLimit()
+{
+    // leave a quarter for the system and for us
+    return getHostPhysicalMemory() / 4 * 3;
+}
+
+ResourcePool &getMemoryPool()
+{
+    static ResourcePool p(getDefaultMemoryLimit());
+    return p;
+}
+
+namespace
+{
+
+struct ResourcePools
+{
+    std::mutex m;
+    std::unordered_map<String, std::shared_ptr<ResourcePool>> pools;
+};
+
+}
+
+static ResourcePools &getResourcePools()
+{
+    static ResourcePools p;
+    return p;
+}
+
+std::shared_ptr<ResourcePool> getResourcePool(const String &name, int n)
+{
+    auto &rp = getResourcePools();
+    std::unique_lock lk(rp.m);
+    auto &p = rp.pools[name];
+    if (!p)
+    {
+        p = std::make_shared<ResourcePool>(n);
+        p->name = name;
+    }
+    return p;
+}
+
+void resetResourcePools()
+{
+    {
+        auto &rp = getResourcePools();
+        std::unique_lock lk(rp.m);
+        rp.pools.clear();
+    }
+    getMemoryPool().setLimit(getDefaultMemoryLimit());
+}
+
+static void killProcess(int64_t pid)
+{
+    if (pid <= 0)
+        return;
+#ifdef _WIN32
+    if (auto h = OpenProcess(PROCESS_TERMINATE, FALSE, (DWORD)pid))
+    {
+        TerminateProcess(h, 1);
+        CloseHandle(h);
+    }
+#else
+    ::kill((pid_t)pid, SIGKILL);
+#endif
+}
+
+#ifdef __linux__
+// Samples resource usage of process trees of running commands.
+// Children are reaped inside primitives::Command, so we cannot use wait4() rusage.
+// Instead every command gets a waiter that takes the last sample while the child is a zombie.
+// Reaping is not ours, so the waiter may lose that race; such usage is marked approximate.
+struct ProcessMonitor
+{
+    struct ProcessStat
+    {
+        uint64_t utime = 0; // ticks
+        uint64_t stime = 0; // ticks
+        uint64_t cutime = 0; // ticks, reaped children
+        uint64_t cstime = 0; // ticks, reaped children
+        // whole thread group with reaped children
+        uint64_t rchar = 0;
+        uint64_t wchar = 0;
+        // not reaped yet, their usage is not in the numbers above
+        std::vector<int> children;
+    };
+    using Processes = std::unordered_map<int, ProcessStat>;
+
+    struct Scope
+    {
+        ResourceUsage &usage;
+        // the child is forked by the executing thread
+        const int tid;
+        // published by the waiter, 0 when not started or already exited
+        std::atomic<int> pid{ 0 };
+        // stays valid after reap, so it is never a reused pid
+        std::atomic<int> pidfd{ -1 };
+        std::atomic_bool stopped{ false };
+        int root = 0;
+        bool final_sampled = false;
+        uint64_t peak_memory = 0;
+        // last sample of every process seen
+        Processes processes;
+        std::thread waiter;
+
+        Scope(ResourceUsage &usage)
+            : usage(usage), tid((int)syscall(SYS_gettid))
+        {
+            get().add(*this);
+            waiter = std::thread([this] { wait(); });
+        }
+
+        ~Scope()
+        {
+            stopped = true;
+            waiter.join();
+            get().remove(*this);
+            if (pidfd != -1)
+                close(pidfd);
+
+            static const auto ticks = sysconf(_SC_CLK_TCK);
+            ProcessStat total;
+            std::unordered_set<int> visited;
+            sum(root, total, visited);
+            usage.user_time = std::chrono::microseconds((total.utime + total.cutime) * 1'000'000 / ticks);
+            usage.system_time = std::chrono::microseconds((total.stime + total.cstime) * 1'000'000 / ticks);
+            usage.bytes_read = total.rchar;
+            usage.bytes_written = total.wchar;
+            usage.peak_memory = peak_memory;
+            usage.approximate = !final_sampled;
+        }
+
+        // kills the whole tree, grandchildren may hold our pipes
+        void kill()
+        {
+            int fd = pidfd;
+            if (fd == -1)
+            {
+                // old kernel
+                if (int p = pid; p > 0)
+                    killProcess(p);
+                return;
+            }
+            // already reaped
+            if (syscall(SYS_pidfd_send_signal, fd, SIGSTOP, nullptr, 0) != 0)
+                return;
+            waitStopped(root);
+
+            // stopped parents do not fork or reap, so collected pids are not reused
+            std::vector<int> tree{ root };
+            for (size_t i = 0; i < tree.size(); i++)
+            {
+                std::error_code ec;
+                for (auto &t : fs::directory_iterator("/proc/" + std::to_string(tree[i]) + "/task", ec))
+                {
+                    std::ifstream ifs(t.path() / "children");
+                    int child;
+                    while (ifs >> child)
+                    {
+                        ::kill(child, SIGSTOP);
+                        waitStopped(child);
+                        tree.push_back(child);
+                    }
+                }
+            }
+            // children first, while their parents are still there
+            for (auto i = tree.rbegin(); i != std::prev(tree.rend()); ++i)
+                ::kill(*i, SIGKILL);
+            syscall(SYS_pidfd_send_signal, fd, SIGKILL, nullptr, 0);
+        }
+
+    private:
+        static void waitStopped(int pid)
+        {
+            for (int i = 0; i < 100; i++)
+            {
+                std::ifstream ifs("/proc/" + std::to_string(pid) + "/stat");
+                String s;
+                if (!std::getline(ifs, s))
+                    return;
+                auto p = s.rfind(')');
+                if (p == s.npos || p + 2 >= s.size() || s[p + 2] != 'R' && s[p + 2] != 'S' && s[p + 2] != 'D')
+                    return;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        void wait()
+        {
+            int p = 0;
+            while (!stopped && (p = findChild(tid)) <= 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            if (p <= 0)
+                return;
+            int fd = (int)syscall(SYS_pidfd_open, p, 0);
+            // it could be reaped (and the pid reused) before we got pidfd
+            if (fd != -1 && findChild(tid) != p)
+            {
+                close(fd);
+                return;
+            }
+            {
+                std::unique_lock lk(get().m);
+                root = p;
+                pid = p;
+            }
+            pidfd = fd;
+            if (fd == -1)
+                return; // old kernel, periodic samples only
+
+            pollfd pfd{ fd, POLLIN, 0 };
+            while (!stopped)
+            {
+                auto r = poll(&pfd, 1, 10);
+                if (r == 0 || (r < 0 && errno == EINTR))
+                    continue;
+                break;
+            }
+
+            std::unique_lock lk(get().m);
+            pid = 0; // stop periodic samples, the pid may be reused soon
+            if (!isZombie(fd))
+                return;
+            auto prev = processes;
+            sample(processes, p);
+            // check that we've read the zombie and not a process with reused pid
+            if (isZombie(fd))
+                final_sampled = true;
+            else
+                processes = std::move(prev);
+        }
+
+        // exited, but not reaped
+        static bool isZombie(int fd)
+        {
+            siginfo_t si{};
+            return waitid((idtype_t)P_PIDFD, fd, &si, WEXITED | WNOWAIT | WNOHANG) == 0 && si.si_pid;
+        }
+
+        static int findChild(int tid)
+        {
+            std::ifstream ifs("/proc/self/task/" + std::to_string(tid) + "/children");
+            int child = 0;
+            ifs >> child;
+            return child;
+        }
+
+        void sum(int p, ProcessStat &total, std::unordered_set<int> &visited) const
+        {
+            auto i = processes.find(p);
+            if (i == processes.end() || !visited.insert(p).second)
+                return;
+            auto &s = i->second;
+            total.utime += s.utime;
+            total.stime += s.stime;
+            total.cutime += s.cutime;
+            total.cstime += s.cstime;
+            total.rchar += s.rchar;
+            total.wchar += s.wchar;
+            for (auto c : s.children)
+                sum(c, total, visited);
+        }
+    };
+
+    ~ProcessMonitor()
+    {
+        {
+            std::unique_lock lk(m);
+            stopped = true;
+        }
+        cv.notify_all();
+        if (t.joinable())
+            t.join();
+    }
+
+    static ProcessMonitor &get()
+    {
+        static ProcessMonitor pm;
+        return pm;
+    }
+
+private:
+    std::mutex m;
+    std::condition_variable cv;
+    std::unordered_set<Scope *> scopes;
+    std::thread t;
+    bool stopped = false;
+
+    void add(Scope &s)
+    {
+        std::unique_lock lk(m);
+        scopes.insert(&s);
+        if (!t.joinable())
+            t = std::thread([this] { run(); });
+        lk.unlock();
+        cv.notify_all();
+    }
+
+    void remove(Scope &s)
+    {
+        std::unique_lock lk(m);
+        scopes.erase(&s);
+    }
+
+    void run()
+    {
+        std::unique_lock lk(m);
+        while (!stopped)
+        {
+            cv.wait(lk, [this] { return stopped || !scopes.empty(); });
+            cv.wait_for(lk, std::chrono::milliseconds(50), [this] { return stopped; });
+            for (auto s : scopes)
+            {
+                if (int pid = s->pid; pid > 0)
+                    s->peak_memory = std::max(s->peak_memory, sample(s->processes, pid));
+            }
+        }
+    }
+
+    // returns rss of the tree
+    static uint64_t sample(Processes &processes, int pid, int depth = 0)
+    {
+        static const auto page_size = sysconf(_SC_PAGESIZE);
+
+        auto d = "/proc/" + std::to_string(pid);
+        ProcessStat st;
+        {
+            std::ifstream ifs(d + "/stat");
+            String s;
+            // gone, keep the last sample
+            if (!std::getline(ifs, s))
+                return 0;
+            // comm may contain spaces, so skip it
+            auto p = s.rfind(')');
+            if (p != s.npos)
+            {
+                std::istringstream iss(s.substr(p + 1));
+                String skip;
+                for (int i = 0; i < 11; i++)
+                    iss >> skip;
+                iss >> st.utime >> st.stime >> st.cutime >> st.cstime;
+            }
+        }
+
+        uint64_t rss = 0;
+        if (std::ifstream ifs(d + "/statm"); ifs)
+        {
+            uint64_t size, resident;
+            if (ifs >> size >> resident)
+                rss += resident * page_size;
+        }
+        if (std::ifstream ifs(d + "/io"); ifs)
+        {
+            String k;
+            uint64_t v;
+            while (ifs >> k >> v)
+            {
+                if (k == "rchar:")
+                    st.rchar = v;
+                else if (k == "wchar:")
+                    st.wchar = v;
+            }
+        }
+
+        // compiler drivers spawn the real tools, so count children too
+        if (depth < 8)
+        {
+            std::ifstream ifs(d + "/task/" + std::to_string(pid) + "/children");
+            int child;
+            while (ifs >> child)
+            {
+                st.children.push_back(child);
+                rss += sample(processes, child, depth + 1);
+            }
+        }
+        processes[pid] = std::move(st);
+        return rss;
+    }
+};
+#endif
+
 namespace builder
 {
 
@@ -227,6 +637,13 @@ static bool isExplainNeeded()
         || sw::Settings::get_user_settings().gExplainOutdatedToTrace;
 }
 
+// human readable text is expensive, write it only when asked explicitly
+static bool isExplainTextNeeded()
+{
+    return sw::Settings::get_user_settings().explain_outdated_full
+        || sw::Settings::get_user_settings().gExplainOutdatedToTrace;
+}
+
 static String getCommandId(const Command &c)
 {
     String s = c.getName() + ", " + std::to_string(c.getHash()) + ", # of arguments " + std::to_string(c.arguments.size());
@@ -244,13 +661,35 @@ static String getCommandId(const Command &c)
     return s;
 }
 
+template <class F>
+static void explainOutdated(const Command &c, ExplainReason r, const path &p, F &&text)
+{
+    explainRecord(c.getHash(), r, c.getName(), p);
+    if (isExplainTextNeeded())
+        EXPLAIN_OUTDATED("command", true, text(), getCommandId(c));
+}
+
+static ExplainReason getExplainReason(const String &what, bool missing)
+{
+    if (what == "input")
+        return missing ? ExplainReason::InputMissing : ExplainReason::InputChanged;
+    if (what == "output")
+        return missing ? ExplainReason::OutputMissing : ExplainReason::OutputChanged;
+    return missing ? ExplainReason::ImplicitInputMissing : ExplainReason::ImplicitInputChanged;
+}
+
 bool Command::check_if_file_newer(const path &p, const String &what, bool throw_on_missing) const
 {
-    auto s = File(p, getContext().getFileStorage()).isChanged(mtime, throw_on_missing);
+    File f(p, getContext().getFileStorage());
+    auto s = f.isChanged(mtime, throw_on_missing);
     if (s && isExplainNeeded())
     {
-        EXPLAIN_OUTDATED("command", true, what + " changed " + to_string(p) + " (command_storage = " +
-            to_string(command_storage->root) + ") : " + *s, getCommandId(*this));
+        auto missing = f.getFileData().last_write_time == fs::file_time_type::min();
+        explainOutdated(*this, getExplainReason(what, missing), p, [&]
+        {
+            return what + " changed " + to_string(p) + " (command_storage = " +
+                to_string(command_storage->root) + ") : " + *s;
+        });
     }
     return !!s;
 }
@@ -260,14 +699,14 @@ bool Command::isOutdated() const
     if (always)
     {
         if (isExplainNeeded())
-            EXPLAIN_OUTDATED("command", true, "always build", getCommandId(*this));
+            explainOutdated(*this, ExplainReason::AlwaysBuild, {}, [] { return "always build"; });
         return true;
     }
 
     if (!command_storage)
     {
         if (isExplainNeeded())
-            EXPLAIN_OUTDATED("command", true, "command storage is disabled", getCommandId(*this));
+            explainOutdated(*this, ExplainReason::NoCommandStorage, {}, [] { return "command storage is disabled"; });
         return true;
     }
 
@@ -278,13 +717,20 @@ bool Command::isOutdated() const
         // we have insertion, no previous value available
         // so outdated
         if (isExplainNeeded())
-            EXPLAIN_OUTDATED("command", true, "new command (command_storage = " + to_string(command_storage->root) + "): " + print(), getCommandId(*this));
+        {
+            explainOutdated(*this, ExplainReason::NewCommand, {}, [this]
+            {
+                return "new command (command_storage = " + to_string(command_storage->root) + "): " + print();
+            });
+        }
         return true;
     }
     else
     {
         ((Command*)(this))->mtime = r.first->mtime;
         ((Command*)(this))->implicit_inputs = r.first->getImplicitInputs(command_storage->getInternalStorage());
+        if (r.first->usage.peak_memory)
+            ((Command*)(this))->memory = r.first->usage.peak_memory;
         return isTimeChanged();
     }
 }
@@ -537,14 +983,19 @@ void Command::execute0(std::error_code *ec)
         }
     }
 
+    bool started = false;
     SCOPE_EXIT
     {
-        if (pool && executed_.v)
+        if (!started)
+            return;
+        getMemoryPool().unlock(memory);
+        if (pool)
             pool->unlock();
     };
 
     if (!beforeCommand())
         return;
+    started = true;
     execute1(ec); // main thing
     if (ec && *ec)
         return;
@@ -568,6 +1019,7 @@ bool Command::beforeCommand()
     {
         executed_ = true;
         (*current_command)++;
+        TimeTrace::get().addCounter("up-to-date commands", 1);
         return false;
     }
 
@@ -581,6 +1033,7 @@ bool Command::beforeCommand()
     // check our resources (before log)
     if (pool)
         pool->lock();
+    getMemoryPool().lock(memory);
 
     printLog();
     return true;
@@ -642,11 +1095,24 @@ void Command::afterCommand()
     // On the next run command times won't be compared with missing deps,
     // so outdated command will not be re-runned
 
+    // used to estimate costs of sources (e.g. for unity builds)
+    if (!timing_input.empty() && t_end > t_begin)
+        command_storage->setInputTiming(timing_input, std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_begin));
+
     auto k = getHash();
     auto &r = *command_storage->insert(k).first;
     r.hash = k;
     r.mtime = mtime;
     r.setImplicitInputs(implicit_inputs, command_storage->getInternalStorage());
+    if (exit_code)
+    {
+        // learn only from complete measurements,
+        // commands shorter than the sampling period have no peak at all
+        auto peak = r.usage.peak_memory;
+        r.usage = usage;
+        if (usage.approximate || !usage.peak_memory)
+            r.usage.peak_memory = peak;
+    }
     command_storage->async_command_log(r);
 }
 
@@ -707,13 +1173,26 @@ void Command::execute1(std::error_code *ec)
     // Some systems have limitation on its length.
 
     path rsp_file;
+    bool remove_rsp_file = false;
     if (needsResponseFile())
     {
-        auto t = support::temp_directory_path() / getResponseFilename();
-        auto fn = t.filename();
-        t = t.parent_path();
-        rsp_file = t / getProgramName() / "rsp" / fn;
-        write_file(rsp_file, getResponseFileContents(true));
+        if (!outputs.empty())
+        {
+            // keep rsp file near outputs and rewrite only on changes,
+            // so we do not create and remove files on every run
+            // outputs are unordered, take the first one as FilesSorted does, so the name is stable
+            rsp_file = path(*std::min_element(outputs.begin(), outputs.end())) += ".rsp";
+            write_file_if_different(rsp_file, getResponseFileContents(true));
+        }
+        else
+        {
+            auto t = support::temp_directory_path() / getResponseFilename();
+            auto fn = t.filename();
+            t = t.parent_path();
+            rsp_file = t / getProgramName() / "rsp" / fn;
+            write_file(rsp_file, getResponseFileContents(true));
+            remove_rsp_file = true;
+        }
 
         for (int i = 0; i < getFirstResponseFileArgument(); i++)
             rsp_args.push_back(arguments[i]->clone());
@@ -722,7 +1201,7 @@ void Command::execute1(std::error_code *ec)
 
     SCOPE_EXIT
     {
-        if (!rsp_file.empty())
+        if (remove_rsp_file)
             fs::remove(rsp_file);
     };
 
@@ -740,9 +1219,59 @@ void Command::execute1(std::error_code *ec)
 
     LOG_TRACE(logger, print());
 
+    usage = {};
+#ifdef __linux__
+    ProcessMonitor::Scope pm(usage);
+    auto kill_process = [&pm] { pm.kill(); };
+#else
+    auto kill_process = [this] { killProcess(pid); };
+#endif
+    SCOPE_EXIT
+    {
+        if (exit_code)
+            usage.exit_code = *exit_code;
+    };
+
+    auto run = [this, &rsp_file, &kill_process](std::error_code &ec)
+    {
+        auto re = swctx && !lightweight ? swctx->getRemoteExecutor() : nullptr;
+        if (re && re->execute(*this, rsp_file.empty() ? Files{} : Files{ rsp_file }))
+        {
+            if (exit_code && *exit_code)
+                ec = std::error_code((int)*exit_code, std::generic_category());
+            return;
+        }
+
+        timed_out = false;
+        if (timeout.count() <= 0)
+            return Base::execute(ec);
+
+        std::mutex m;
+        std::condition_variable cv;
+        bool done = false;
+        std::thread watchdog([this, &m, &cv, &done, &kill_process]
+        {
+            std::unique_lock lk(m);
+            if (cv.wait_for(lk, timeout, [&done] { return done; }))
+                return;
+            timed_out = true;
+            kill_process();
+        });
+        SCOPE_EXIT
+        {
+            {
+                std::unique_lock lk(m);
+                done = true;
+            }
+            cv.notify_all();
+            watchdog.join();
+        };
+        Base::execute(ec);
+    };
+
     if (ec)
     {
-        Base::execute(*ec);
+        run(*ec);
         if (ec)
         {
             // TODO: save error string
@@ -753,7 +1282,7 @@ void Command::execute1(std::error_code *ec)
     else
     {
         std::error_code ec;
-        Base::execute(ec);
+        run(ec);
         if (ec)
         {
             auto err = make_error_string();
@@ -794,6 +1323,8 @@ void Command::printOutputs()
 String Command::makeErrorString()
 {
     auto err = "command failed"s;
+    if (timed_out)
+        err = "command timed out after " + std::to_string(timeout.count()) + " ms";
     auto errors = getErrors();
     if (errors.empty())
         return makeErrorString(err);
@@ -1073,6 +1604,48 @@ void Command::postProcess(bool ok)
     }
 }
 
+#ifdef __linux__
+// exec* limits: ARG_MAX is for arguments + environment (including pointers),
+// and every single string is limited by MAX_ARG_STRLEN
+static bool needsResponseFileLinux(const Command &c)
+{
+    static const size_t max_arg_strlen = 32 * 4096; // MAX_ARG_STRLEN
+    static const size_t headroom = 4096; // same as xargs
+    static const size_t arg_max = []() -> size_t
+    {
+        auto n = sysconf(_SC_ARG_MAX);
+        return n > 0 ? n : 2'000'000;
+    }();
+    static const size_t env_size = []()
+    {
+        size_t sz = 0;
+        for (auto e = environ; e && *e; e++)
+            sz += strlen(*e) + 1 + sizeof(char *);
+        return sz;
+    }();
+
+    bool too_long_arg = false;
+    size_t sz = env_size + c.getProgram().size() + 1 + sizeof(char *);
+    for (auto &[k, v] : c.environment)
+        sz += k.size() + v.size() + 2 + sizeof(char *);
+    for (auto a = c.arguments.begin() + c.getFirstResponseFileArgument(); a != c.arguments.end(); a++)
+    {
+        auto asz = (*a)->toString().size() + 1;
+        too_long_arg |= asz > max_arg_strlen;
+        sz += asz + sizeof(char *);
+    }
+    auto need = too_long_arg || sz + headroom > arg_max;
+
+    if (c.use_response_files)
+    {
+        if (!*c.use_response_files && need)
+            LOG_WARN(logger, "Very long command line = " << sz << " and rsp files are disabled. Expect errors.");
+        return *c.use_response_files;
+    }
+    return need;
+}
+#endif
+
 bool Command::needsResponseFile() const
 {
     // we do not use system(), so we really do not care when using exec*
@@ -1085,6 +1658,9 @@ bool Command::needsResponseFile() const
     static constexpr auto apple_sz = 260'000;
     static constexpr auto nix_sz = 2'000'000; // something near 2M
 
+#ifdef __linux__
+    return needsResponseFileLinux(*this);
+#else
     const auto selected_size =
 #ifdef _WIN32
         win_sz
@@ -1097,6 +1673,7 @@ bool Command::needsResponseFile() const
         ;
 
     return needsResponseFile(selected_size);
+#endif
 }
 
 bool Command::needsResponseFile(size_t selected_size) const
@@ -1283,6 +1860,7 @@ BuiltinCommand::BuiltinCommand(const SwBuilderContext &swctx, const String &cmd_
     : BuiltinCommand(swctx)
 {
     first_response_file_argument = 1;
+    lightweight = true;
     arguments.push_back(getInternalCallBuiltinFunctionName());
     arguments.push_back(normalize_path(primitives::getModuleNameForSymbol(f))); // add dependency on this? or on function (command) version
     arguments.push_back(cmd_name);
@@ -1314,16 +1892,37 @@ void BuiltinCommand::execute1(std::error_code *ec)
 {
     // add try catch?
 
-    Strings sa;
-    for (auto &a : arguments)
-        sa.push_back(a->toString());
+    onBeforeRun();
+    SCOPE_EXIT
+    {
+        onEnd();
+    };
 
-    auto start = getFirstResponseFileArgument();
-    jumppad_call(
-        sa[start + 0],
-        sa[start + 1],
-        std::stoi(sa[start + 2]),
-        Strings{ sa.begin() + start + 3, sa.end() });
+    int r;
+    try
+    {
+        if (fn)
+            r = fn();
+        else
+        {
+            Strings sa;
+            for (auto &a : arguments)
+                sa.push_back(a->toString());
+
+            auto start = getFirstResponseFileArgument();
+            r = jumppad_call(
+                sa[start + 0],
+                sa[start + 1],
+                std::stoi(sa[start + 2]),
+                Strings{ sa.begin() + start + 3, sa.end() });
+        }
+    }
+    catch (std::exception &e)
+    {
+        throw SW_RUNTIME_ERROR("When executing: " + getName() + "\n" + e.what());
+    }
+    if (r)
+        throw SW_RUNTIME_ERROR("When executing: " + getName() + "\nbuiltin function returned " + std::to_string(r));
 }
 
 size_t BuiltinCommand::getHash1() const
@@ -1357,8 +1956,165 @@ String getInternalCallBuiltinFunctionName()
     return "internal-call-builtin-function";
 }
 
+int copyFile(path in, path out)
+{
+    error_code ec;
+    fs::create_directories(out.parent_path(), ec);
+    if (!ec)
+        fs::copy_file(in, out, fs::copy_options::overwrite_existing, ec);
+    if (ec)
+        throw SW_RUNTIME_ERROR("Cannot copy " + to_string(in) + " to " + to_string(out) + ": " + ec.message());
+    return 0;
+}
+
 } // namespace builder
 
+// Results of program lookups are stored between runs.
+// Cache is valid while PATH is the same and none of its dirs were changed.
+// Only bare names (which depend on PATH) are stored, other lookups are cached for the process.
+struct ExecutableCache
+{
+    ExecutableCache()
+    {
+        fn = support::temp_directory_path("db") / "executables.json";
+        path_var = getPathVar();
+        for (auto &d : split_string(path_var, getPathSeparator()))
+            dirs[d] = getDirTime(d);
+
+        if (!fs::exists(fn))
+            return;
+        try
+        {
+            auto j = nlohmann::json::parse(read_file(fn));
+            if (j["path"] != path_var)
+                return;
+            for (auto &[d, t] : j["dirs"].items())
+            {
+                if (dirs[d] != t.get<int64_t>())
+                    return;
+            }
+            for (auto &[p, r] : j["programs"].items())
+                programs[fs::u8path(p)] = fs::u8path(r.get<String>());
+        }
+        catch (std::exception &)
+        {
+            error_code ec;
+            fs::remove(fn, ec);
+        }
+    }
+
+    ~ExecutableCache()
+    {
+        save();
+    }
+
+    void save()
+    {
+        std::unique_lock lk(m);
+        if (!changed)
+            return;
+        nlohmann::json j;
+        j["path"] = path_var;
+        for (auto &[d, t] : dirs)
+            j["dirs"][d] = t;
+        for (auto &[p, r] : programs)
+            j["programs"][to_string(p.u8string())] = to_string(r.u8string());
+        try
+        {
+            // other processes may read it at the same time
+            auto tmp = path(fn) += "." + unique_path().string();
+            write_file(tmp, j.dump());
+            fs::rename(tmp, fn);
+            changed = false;
+        }
+        catch (std::exception &)
+        {
+        }
+    }
+
+    std::optional<path> find(const path &p) const
+    {
+        std::unique_lock lk(m);
+        auto &c = isPersistent(p) ? programs : process_programs;
+        auto i = c.find(p);
+        if (i == c.end())
+            return {};
+        return i->second;
+    }
+
+    void add(const path &p, const path &r)
+    {
+        std::unique_lock lk(m);
+        if (!isPersistent(p))
+        {
+            process_programs[p] = r;
+            return;
+        }
+        programs[p] = r;
+        changed = true;
+    }
+
+    static bool isPersistent(const path &p)
+    {
+        return !p.has_parent_path();
+    }
+
+#ifndef _WIN32
+    // same as shell does
+    path search(const path &in) const
+    {
+        for (auto &d : split_string(path_var, getPathSeparator()))
+        {
+            auto p = path(d) / in;
+            if (access(p.c_str(), X_OK) == 0 && fs::is_regular_file(p))
+                return p;
+        }
+        return {};
+    }
+#endif
+
+private:
+    path fn;
+    String path_var;
+    std::map<String, int64_t> dirs;
+    std::unordered_map<path, path> programs;
+    std::unordered_map<path, path> process_programs;
+    mutable std::mutex m;
+    bool changed = false;
+
+    static String getPathVar()
+    {
+        auto p = getenv("PATH");
+        return p ? p : "";
+    }
+
+    static String getPathSeparator()
+    {
+#ifdef _WIN32
+        return ";";
+#else
+        return ":";
+#endif
+    }
+
+    static int64_t getDirTime(const path &d)
+    {
+        error_code ec;
+        return fs::last_write_time(d, ec).time_since_epoch().count();
+    }
+};
+
+static ExecutableCache &getExecutableCache()
+{
+    static ExecutableCache c;
+    return c;
+}
+
+void saveExecutableCache()
+{
+    getExecutableCache().save();
+}
+
 // libuv cannot resolve /such/paths/on/cygwin, so we explicitly use which/where/cygpath
 path resolveExecutable(const path &in)
 {
@@ -1368,21 +2124,28 @@ path resolveExecutable(const path &in)
     if (in.is_absolute() && fs::exists(in))
         return in;
 
+    auto &cache = getExecutableCache();
+    if (auto p = cache.find(in))
+        return *p;
+
+#ifndef _WIN32
+    // no child processes here
+    path result;
+    if (ExecutableCache::isPersistent(in))
+        result = cache.search(in);
+    else
+        result = primitives::resolve_executable(in);
+    cache.add(in, result);
+    return result;
+#else
     if (auto p = primitives::resolve_executable(in); !p.empty())
+    {
+        cache.add(in, p);
         return p;
+    }
 
     // this is expensive resolve, so we cache
 
-    static std::unordered_map<path, path> cache;
-    static std::mutex m;
-
-    {
-        std::unique_lock lk(m);
-        auto i = cache.find(in);
-        if (i != cache.end())
-            return i->second;
-    }
-
     static const auto p_which = primitives::resolve_executable("which");
     static const auto p_where = primitives::resolve_executable("where");
 
@@ -1433,10 +2196,10 @@ path resolveExecutable(const path &in)
         }
     }
 
-    std::unique_lock lk(m);
-    cache[in] = result;
+    cache.add(in, result);
 
     return result;
+#endif
 
     // remove this vvv
     // at the moment we also return empty string on error
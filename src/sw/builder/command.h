@@ -23,7 +23,10 @@
 
 #include <primitives/command.h>
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 
 namespace sw
@@ -33,40 +36,82 @@ struct Program;
 struct SwBuilderContext;
 struct CommandStorage;
 
+// weighted counter
+// requests larger than the whole pool are admitted into an idle pool only
 struct SW_BUILDER_API ResourcePool
 {
-    ResourcePool(int n_resources)
+    String name; // for named pools
+
+    ResourcePool(int64_t n_resources)
     {
-        if (n_resources < 1)
-            return;
-        n = n_resources;
+        setLimit(n_resources);
     }
 
-    void lock()
+    void lock(int64_t w = 1)
     {
-        if (n == -1)
-            return;
         std::unique_lock lk(m);
-        cv.wait(lk, [this] { return n > 0; });
-        --n;
+        if (total == -1)
+            return;
+        w = std::min(w, total);
+        cv.wait(lk, [this, w] { return n >= w; });
+        n -= w;
     }
 
-    void unlock()
+    void unlock(int64_t w = 1)
     {
-        if (n == -1)
-            return;
         std::unique_lock lk(m);
-        ++n;
+        if (total == -1)
+            return;
+        n += std::min(w, total);
         lk.unlock();
-        cv.notify_one();
+        cv.notify_all();
+    }
+
+    // must be called when nothing is locked
+    void setLimit(int64_t n_resources)
+    {
+        std::unique_lock lk(m);
+        total = n = n_resources < 1 ? -1 : n_resources;
     }
 
+    // -1 - unlimited
+    int64_t getLimit() const { return total; }
+
 private:
-    int n = -1; // unlimited
+    int64_t total = -1; // unlimited
+    int64_t n = -1;
     std::condition_variable cv;
     std::mutex m;
 };
 
+// what spawned process (with its children) consumed
+struct ResourceUsage
+{
+    std::chrono::microseconds user_time{ 0 };
+    std::chrono::microseconds system_time{ 0 };
+    uint64_t peak_memory = 0; // bytes
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    int exit_code = 0;
+    // final state of the tree was not sampled (short command, no procfs etc.),
+    // times and i/o may lack the tail, peak memory is not trusted
+    bool approximate = true;
+};
+
+/// global memory budget of build commands, bytes
+/// by default it is based on the amount of physical memory
+SW_BUILDER_API
+ResourcePool &getMemoryPool();
+
+/// named pool for a class of commands (e.g. links), created with n resources on the first call
+SW_BUILDER_API
+std::shared_ptr<ResourcePool> getResourcePool(const String &name, int n);
+
+/// drops named pools and restores default memory budget
+/// resident processes call it between builds, nothing must be running
+SW_BUILDER_API
+void resetResourcePools();
+
 namespace builder
 {
 
@@ -129,7 +174,13 @@ public:
     bool show_output = false; // no command output
     bool write_output_to_file = false;
     int strict_order = 0; // used to execute this before other commands
+    bool lightweight = false; // cheap in-process command, not counted against build jobs
     std::shared_ptr<ResourcePool> pool;
+    uint64_t memory = 0; // estimated peak memory, bytes; replaced with measured value from previous run
+    std::chrono::milliseconds timeout{ 0 }; // process is killed when exceeded, 0 - no limit
+    bool timed_out = false;
+    ResourceUsage usage; // measured during execution
+    path timing_input; // compile commands: source to record execution time for (unity batches)
 
     std::thread::id tid;
     Clock::time_point t_begin;
@@ -238,6 +289,15 @@ private:
     void printOutputs();
 };
 
+// runs commands on other hosts (distributed build)
+struct SW_BUILDER_API RemoteExecutor
+{
+    virtual ~RemoteExecutor() = default;
+
+    // false - command was not executed, run it locally
+    virtual bool execute(Command &, const Files &additional_inputs) = 0;
+};
+
 struct SW_BUILDER_API CommandSequence : Command
 {
     using Command::Command;
@@ -277,7 +337,22 @@ struct SW_BUILDER_API BuiltinCommand : Command
     void push_back(const Files &files);
     void push_back(const FilesOrdered &files);
 
+    // typed in-process call
+    // arguments are also added as strings for hashing and out of process execution
+    template <class R, class ... ArgTypes, class ... Args>
+    void setFunction(R(*f)(ArgTypes...), Args && ... args)
+    {
+        static_assert(sizeof...(ArgTypes) == sizeof...(Args), "incorrect number of arguments");
+        (push_back(args), ...);
+        fn = [f, t = std::tuple<std::decay_t<ArgTypes>...>(std::forward<Args>(args)...)]()
+        {
+            return (int)std::apply(f, t);
+        };
+    }
+
 private:
+    std::function<int()> fn;
+
     void execute1(std::error_code *ec = nullptr) override;
     size_t getHash1() const override;
     void prepare() override {}
@@ -295,6 +370,10 @@ private:
 SW_BUILDER_API
 String getInternalCallBuiltinFunctionName();
 
+/// sw_copy_file builtin, throws with the reason on errors
+SW_BUILDER_API
+int copyFile(path in, path out);
+
 } // namespace bulder
 
 using builder::BuiltinCommand;
@@ -307,6 +386,11 @@ path resolveExecutable(const path &p);
 SW_BUILDER_API
 path resolveExecutable(const FilesOrdered &paths);
 
+/// writes resolved executables to disk if there are new ones
+/// called after builds, resident processes never reach static destructors
+SW_BUILDER_API
+void saveExecutableCache();
+
 // serialization
 
 // remember to set context and command storage after loading
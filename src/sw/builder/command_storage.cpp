@@ -35,7 +35,7 @@
 #include <primitives/log.h>
 DECLARE_STATIC_LOGGER(logger, "db_file");
 
-#define COMMAND_DB_FORMAT_VERSION 8
+#define COMMAND_DB_FORMAT_VERSION 10
 
 namespace sw
 {
@@ -60,6 +60,11 @@ static path getCommandsDbFilename(const path &root)
     return getDir(root) / std::to_string(COMMAND_DB_FORMAT_VERSION) / "commands.bin";
 }
 
+static path getTimingsDbFilename(const path &root)
+{
+    return getDir(root) / std::to_string(COMMAND_DB_FORMAT_VERSION) / "timings.bin";
+}
+
 static path getCommandsLogFileName(const path &root)
 {
     auto cfg = shorten_hash(blake2b_512(getCurrentModuleNameHash()), 12);
@@ -139,6 +144,12 @@ void FileDb::write(std::vector<uint8_t> &v, const CommandRecord &f, const detail
 
     write_int(v, f.hash);
     write_int(v, f.mtime);
+    write_int(v, f.usage.user_time.count());
+    write_int(v, f.usage.system_time.count());
+    write_int(v, f.usage.peak_memory);
+    write_int(v, f.usage.bytes_read);
+    write_int(v, f.usage.bytes_written);
+    write_int(v, f.usage.exit_code);
 
     auto n = f.implicit_inputs.size();
     write_int(v, n);
@@ -219,6 +230,16 @@ static void load(const path &fn, Files &files, std::unordered_map<size_t, path>
                 //throw SW_RUNTIME_ERROR("x");
 
             b.read(r.first->mtime);
+            auto &u = r.first->usage;
+            decltype(u.user_time.count()) t;
+            b.read(t);
+            u.user_time = decltype(u.user_time)(t);
+            b.read(t);
+            u.system_time = decltype(u.system_time)(t);
+            b.read(u.peak_memory);
+            b.read(u.bytes_read);
+            b.read(u.bytes_written);
+            b.read(u.exit_code);
 
             size_t n;
             b.read(n);
@@ -425,11 +446,55 @@ detail::FileHolder &detail::Storage::getFileLog(const SwBuilderContext &swctx, c
 void CommandStorage::load()
 {
     fdb.load(s.file_storage, s.file_storage_by_hash, s.storage, root);
+
+    auto fn = getTimingsDbFilename(root);
+    if (!fs::exists(fn))
+        return;
+    primitives::BinaryStream b;
+    b.load(fn);
+    while (b.has(sizeof(size_t) + sizeof(uint32_t)))
+    {
+        size_t h;
+        uint32_t t;
+        b.read(h);
+        b.read(t);
+        input_timings[h] = t;
+    }
 }
 
 void CommandStorage::save1()
 {
     fdb.save(s.file_storage, s, s.storage, root);
+
+    std::unique_lock lk(m);
+    if (input_timings.empty())
+        return;
+    primitives::BinaryStream b(input_timings.size() * (sizeof(size_t) + sizeof(uint32_t)));
+    for (auto &[h, t] : input_timings)
+    {
+        b.write(h);
+        b.write(t);
+    }
+    auto p = getTimingsDbFilename(root);
+    fs::create_directories(p.parent_path());
+    b.save(p);
+}
+
+std::optional<std::chrono::milliseconds> CommandStorage::getInputTiming(const path &p) const
+{
+    auto h = file_hash(normalize_path(p));
+    std::unique_lock lk(m);
+    auto i = input_timings.find(h);
+    if (i == input_timings.end())
+        return {};
+    return std::chrono::milliseconds(i->second);
+}
+
+void CommandStorage::setInputTiming(const path &p, std::chrono::milliseconds t)
+{
+    auto h = file_hash(normalize_path(p));
+    std::unique_lock lk(m);
+    input_timings[h] = (uint32_t)t.count();
 }
 
 ConcurrentCommandStorage &CommandStorage::getStorage()
@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "command.h"
 #include "concurrent_map.h"
 
 #include <boost/thread/shared_mutex.hpp>
@@ -25,6 +26,8 @@
 #include <primitives/templates.h>
 
 #include <atomic>
+#include <chrono>
+#include <optional>
 
 namespace sw
 {
@@ -53,6 +56,7 @@ struct CommandRecord
     fs::file_time_type mtime = fs::file_time_type::min();
     //Files implicit_inputs;
     std::unordered_set<size_t> implicit_inputs;
+    ResourceUsage usage; // of the last run
 
     Files getImplicitInputs(detail::Storage &) const;
     void setImplicitInputs(const Files &, detail::Storage &);
@@ -110,11 +114,16 @@ struct SW_BUILDER_API CommandStorage
     void free_user();
     std::pair<CommandRecord *, bool> insert(size_t hash);
 
+    /// last known compile time of a source file
+    std::optional<std::chrono::milliseconds> getInputTiming(const path &) const;
+    void setInputTiming(const path &, std::chrono::milliseconds);
+
 private:
     FileDb fdb;
     detail::Storage s;
     std::atomic_int n_users{ 0 };
-    std::mutex m;
+    mutable std::mutex m;
+    std::unordered_map<size_t, uint32_t> input_timings; // ms
     std::unique_ptr<ScopedFileLock> lock;
     bool saved = false;
     bool changed = false;
@@ -128,6 +128,12 @@ struct ConcurrentMap
         return *insert(k).first;
     }
 
+    /// nullptr if there is no such key
+    V *find(K k) const
+    {
+        return map->get(k);
+    }
+
     const V &operator[](K k) const
     {
         return *insert(k).first;
@@ -18,15 +18,27 @@
 
 #include "execution_plan.h"
 
+#include "time_trace.h"
+
 #include <sw/support/exceptions.h>
 
 #include <nlohmann/json.hpp>
 #include <primitives/exceptions.h>
 #include <primitives/executor.h>
 
+#include <thread>
+
 namespace sw
 {
 
+// separate pool for cheap in-process commands
+// they do not take build job slots
+static Executor &getLightweightExecutor()
+{
+    static Executor e(std::max(2u, std::thread::hardware_concurrency()));
+    return e;
+}
+
 ExecutionPlan::ExecutionPlan(USet &cmds)
 {
     init(cmds);
@@ -74,6 +86,17 @@ void ExecutionPlan::execute(Executor &e) const
 
     bool build_commands = dynamic_cast<builder::Command *>(*commands.begin());
 
+    // respect single job builds
+    auto &le = e.numberOfThreads() > 1 ? getLightweightExecutor() : e;
+    auto &tt = TimeTrace::get();
+    auto push = [&e, &le, &tt, build_commands](auto &&f, T *c)
+    {
+        tt.addCounter("ready commands", 1);
+        if (build_commands && static_cast<builder::Command*>(c)->lightweight)
+            return le.push(f);
+        return e.push(f);
+    };
+
     // set numbers
     std::atomic_size_t current_command = 1;
     std::atomic_size_t total_commands = commands.size();
@@ -92,19 +115,20 @@ void ExecutionPlan::execute(Executor &e) const
     }
 
     std::function<void(PtrT)> run;
-    run = [this, &askip_errors, &e, &run, &fs, &all, &m, &running, &stopped](T *c)
+    run = [this, &askip_errors, &push, &run, &fs, &all, &m, &running, &stopped, &tt](T *c)
     {
+        tt.addCounter("ready commands", -1);
         if (stopped || interrupted)
             return;
         try
         {
-            running++;
+            tt.setCounter("running commands", ++running);
             c->execute();
-            running--;
+            tt.setCounter("running commands", --running);
         }
         catch (...)
         {
-            running--;
+            tt.setCounter("running commands", --running);
             if (--askip_errors < 1)
                 stopped = true;
             if (throw_on_errors)
@@ -115,7 +139,7 @@ void ExecutionPlan::execute(Executor &e) const
             if (--d->dependencies_left == 0)
             {
                 std::unique_lock<std::mutex> lk(m);
-                fs.push_back(e.push([&run, d] {run(d); }));
+                fs.push_back(push([&run, d] {run(d); }, d));
                 all.push_back(fs.back());
             }
         }
@@ -140,7 +164,7 @@ void ExecutionPlan::execute(Executor &e) const
             if (!c->getDependencies().empty())
                 //continue;
                 break;
-            fs.push_back(e.push([&run, c] {run(c); }));
+            fs.push_back(push([&run, c] {run(c); }, c));
             all.push_back(fs.back());
         }
     }
@@ -196,6 +220,13 @@ void ExecutionPlan::execute(Executor &e) const
 
 void ExecutionPlan::saveChromeTrace(const path &p) const
 {
+    saveChromeTrace(p, commands);
+}
+
+void ExecutionPlan::saveChromeTrace(const path &p, const VecT &commands)
+{
+    auto tevents = TimeTrace::get().getEvents();
+
     // calculate minimal time
     auto min = decltype (builder::Command::t_begin)::clock::now();
     for (auto &c : commands)
@@ -204,6 +235,8 @@ void ExecutionPlan::saveChromeTrace(const path &p) const
             continue;
         min = std::min(static_cast<builder::Command*>(c)->t_begin, min);
     }
+    for (auto &e : tevents)
+        min = std::min(e.begin, min);
 
     auto tid_to_ll = [](auto &id)
     {
@@ -242,6 +275,38 @@ void ExecutionPlan::saveChromeTrace(const path &p) const
             e["args"]["command_line"].push_back(a->toString());
         for (auto &[k, v] : c2->environment)
             e["args"]["environment"][k] = v;
+        if (c2->exit_code)
+        {
+            auto &u = c2->usage;
+            auto &r = e["args"]["resources"];
+            r["user_time_us"] = u.user_time.count();
+            r["system_time_us"] = u.system_time.count();
+            r["peak_memory"] = u.peak_memory;
+            r["bytes_read"] = u.bytes_read;
+            r["bytes_written"] = u.bytes_written;
+            r["exit_code"] = u.exit_code;
+            r["approximate"] = u.approximate;
+        }
+        events.push_back(e);
+    }
+    for (auto &te : tevents)
+    {
+        nlohmann::json e;
+        e["name"] = te.name;
+        e["cat"] = te.cat;
+        e["pid"] = 1;
+        e["ts"] = std::chrono::duration_cast<std::chrono::microseconds>(te.begin - min).count();
+        if (te.counter)
+        {
+            e["ph"] = "C";
+            e["args"]["value"] = te.value;
+        }
+        else
+        {
+            e["ph"] = "X";
+            e["tid"] = tid_to_ll(te.tid);
+            e["dur"] = std::chrono::duration_cast<std::chrono::microseconds>(te.end - te.begin).count();
+        }
         events.push_back(e);
     }
     trace["traceEvents"] = events;
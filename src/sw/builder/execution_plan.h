@@ -84,6 +84,8 @@ public:
     void save(const path &, int type = 0) const;
 
     void saveChromeTrace(const path &) const;
+    // also writes events recorded by TimeTrace
+    static void saveChromeTrace(const path &, const VecT &commands);
     void setTimeLimit(const Clock::duration &);
 
     const VecT &getCommands() const { return commands; }
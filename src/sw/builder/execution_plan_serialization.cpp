@@ -33,8 +33,14 @@
 
 #include "sw_context.h"
 
+#include <sw/manager/settings.h>
 #include <sw/support/serialization.h>
 
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string_view>
+
 #define SERIALIZATION_TYPE sw::builder::Command
 SERIALIZATION_BEGIN_UNIFIED
     ar & boost::serialization::base_object<::primitives::Command>(v);
@@ -117,41 +123,452 @@ SERIALIZATION_SPLIT_END
 namespace sw
 {
 
-Commands ExecutionPlan::load(const path &p, const SwBuilderContext &swctx, int type)
+// compact binary plan
+//
+// header | command records | string table | command index
+//
+// all strings (args, env, paths) are interned, records refer to them by id
+//
+// record: plan part | details
+// plan part (name, flags, hash, files) is enough to build and check the plan,
+// details (args, env, redirections, deps) are decoded only for commands to be executed
+
+static const char explan_magic[4] = { 'S', 'W', 'E', 'P' };
+// bump on any format change
+static const uint32_t explan_version = 2;
+static const uint32_t explan_no_string = (uint32_t)-1;
+
+namespace
 {
-    Commands commands;
 
-    auto load = [&commands](auto &ar)
+struct ExplanHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t size; // of the whole file
+    uint64_t strings_offset;
+    uint64_t index_offset;
+    uint32_t n_strings;
+    uint32_t n_commands;
+    uint32_t cwd;
+    uint32_t reserved;
+};
+
+enum ExplanCommandFlags : uint32_t
+{
+    ExplanAlways = 1 << 0,
+    ExplanRemoveOutputs = 1 << 1,
+    ExplanOutAppend = 1 << 2,
+    ExplanErrAppend = 1 << 3,
+    ExplanUseResponseFilesSet = 1 << 4,
+    ExplanUseResponseFiles = 1 << 5,
+};
+
+struct ExplanWriter
+{
+    std::vector<uint8_t> data;
+
+    ExplanWriter()
     {
-        path cp;
-        ar >> cp;
-        fs::current_path(cp);
-        ar >> commands;
-    };
+        data.resize(sizeof(ExplanHeader));
+    }
 
-    type = 1;
-    if (type == 0)
-    {
-        std::ifstream ifs(p, std::ios_base::in | std::ios_base::binary);
+    template <class T>
+    void write(const T &v)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto p = (const uint8_t *)&v;
+        data.insert(data.end(), p, p + sizeof(T));
+    }
+
+    uint32_t id(const String &s)
+    {
+        if (s.empty())
+            return explan_no_string;
+        auto [i, inserted] = ids.try_emplace(s, (uint32_t)strings.size());
+        if (inserted)
+            strings.push_back(&i->first);
+        return i->second;
+    }
+
+    uint32_t id(const path &p)
+    {
+        return id(to_string(p));
+    }
+
+    void writeString(const String &s)
+    {
+        write(id(s));
+    }
+
+    void writeString(const path &p)
+    {
+        write(id(p));
+    }
+
+    template <class C>
+    void writeFiles(const C &files)
+    {
+        write((uint32_t)files.size());
+        for (auto &f : files)
+            writeString(f);
+    }
+
+    void writeCommand(const builder::Command &c)
+    {
+        index.push_back(data.size());
+
+        uint32_t flags = 0;
+        if (c.always)
+            flags |= ExplanAlways;
+        if (c.remove_outputs_before_execution)
+            flags |= ExplanRemoveOutputs;
+        if (c.out.append)
+            flags |= ExplanOutAppend;
+        if (c.err.append)
+            flags |= ExplanErrAppend;
+        if (c.use_response_files)
+        {
+            flags |= ExplanUseResponseFilesSet;
+            if (*c.use_response_files)
+                flags |= ExplanUseResponseFiles;
+        }
+
+        writeString(c.name);
+        writeString(c.command_storage ? c.command_storage->root : path{});
+        write(flags);
+        write((int32_t)c.strict_order);
+        write((uint64_t)c.getHash());
+        writeFiles(c.inputs);
+        writeFiles(c.outputs);
+        writeFiles(c.output_dirs);
+
+        // details
+        write((int32_t)c.first_response_file_argument);
+        write((uint32_t)c.deps_processor);
+        writeString(c.deps_module);
+        writeString(c.deps_function);
+        writeString(c.deps_file);
+        writeString(c.msvc_prefix);
+
+        writeString(c.working_directory);
+        writeString(c.in.file);
+        writeString(c.out.file);
+        writeString(c.err.file);
+
+        write((uint32_t)c.arguments.size());
+        for (auto &a : c.arguments)
+            writeString(a->toString());
+        write((uint32_t)c.environment.size());
+        for (auto &[k, v] : c.environment)
+        {
+            writeString(k);
+            writeString(v);
+        }
+    }
+
+    void finish(const path &cwd)
+    {
+        ExplanHeader h{};
+        memcpy(h.magic, explan_magic, sizeof(h.magic));
+        h.version = explan_version;
+        h.n_commands = (uint32_t)index.size();
+        h.cwd = id(cwd);
+
+        h.strings_offset = data.size();
+        h.n_strings = (uint32_t)strings.size();
+        for (auto s : strings)
+        {
+            write((uint32_t)s->size());
+            data.insert(data.end(), s->begin(), s->end());
+        }
+
+        h.index_offset = data.size();
+        for (auto o : index)
+            write(o);
+
+        h.size = data.size();
+        memcpy(data.data(), &h, sizeof(h));
+    }
+
+private:
+    std::unordered_map<String, uint32_t> ids;
+    std::vector<const String *> strings;
+    std::vector<uint64_t> index;
+};
+
+struct ExplanReader
+{
+    ExplanReader(const path &fn)
+    {
+        std::ifstream ifs(fn, std::ios_base::in | std::ios_base::binary);
         if (!ifs)
-            throw SW_RUNTIME_ERROR("Cannot read file: " + to_string(p));
-        boost::archive::binary_iarchive ar(ifs);
-        load(ar);
+            throw SW_RUNTIME_ERROR("Cannot read file: " + to_string(fn));
+        data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        validate(fn);
     }
-    else if (type == 1)
-    {
+
+    static bool isExplan(const path &fn)
+    {
+        std::ifstream ifs(fn, std::ios_base::in | std::ios_base::binary);
+        char m[sizeof(explan_magic)]{};
+        ifs.read(m, sizeof(m));
+        return ifs && memcmp(m, explan_magic, sizeof(m)) == 0;
+    }
+
+    size_t size() const { return h.n_commands; }
+    path getCurrentPath() const { return getString(h.cwd); }
+
+    // returns hash and position of command details
+    std::pair<size_t, uint64_t> readPlan(builder::Command &c, size_t i) const
+    {
+        uint64_t pos;
+        memcpy(&pos, &data[h.index_offset + i * sizeof(pos)], sizeof(pos));
+        Cursor r{ *this, pos, h.strings_offset };
+
+        c.name = r.string();
+        c.command_storage_root = r.string();
+        auto flags = r.read<uint32_t>();
+        c.always = flags & ExplanAlways;
+        c.remove_outputs_before_execution = flags & ExplanRemoveOutputs;
+        c.out.append = flags & ExplanOutAppend;
+        c.err.append = flags & ExplanErrAppend;
+        if (flags & ExplanUseResponseFilesSet)
+            c.use_response_files = !!(flags & ExplanUseResponseFiles);
+        c.strict_order = r.read<int32_t>();
+        auto hash = (size_t)r.read<uint64_t>();
+        r.files(c.inputs);
+        r.files(c.outputs);
+        r.files(c.output_dirs);
+        return { hash, r.pos };
+    }
+
+    void readDetails(builder::Command &c, uint64_t pos) const
+    {
+        Cursor r{ *this, pos, h.strings_offset };
+        c.first_response_file_argument = r.read<int32_t>();
+        c.deps_processor = (builder::Command::DepsProcessor)r.read<uint32_t>();
+        c.deps_module = r.string();
+        c.deps_function = r.string();
+        c.deps_file = r.string();
+        c.msvc_prefix = r.string();
+
+        c.working_directory = r.string();
+        c.in.file = r.string();
+        c.out.file = r.string();
+        c.err.file = r.string();
+
+        auto n = r.count();
+        c.arguments.reserve(n);
+        while (n--)
+            c.arguments.push_back(std::make_unique<primitives::command::SimpleArgument>(r.string()));
+        n = r.count();
+        while (n--)
+        {
+            auto k = r.string();
+            c.environment[k] = r.string();
+        }
+    }
+
+private:
+    std::vector<uint8_t> data;
+    ExplanHeader h;
+    std::vector<std::string_view> strings;
+
+    struct Cursor
+    {
+        const ExplanReader &r;
+        uint64_t pos;
+        uint64_t end;
+
+        template <class T>
+        T read()
+        {
+            if (pos + sizeof(T) > end)
+                throw SW_RUNTIME_ERROR("Corrupted execution plan: unexpected end of data");
+            T v;
+            memcpy(&v, &r.data[pos], sizeof(T));
+            pos += sizeof(T);
+            return v;
+        }
+
+        uint32_t count()
+        {
+            auto n = read<uint32_t>();
+            // every element takes at least a string id
+            if (n > (end - pos) / sizeof(uint32_t))
+                throw SW_RUNTIME_ERROR("Corrupted execution plan: bad element count");
+            return n;
+        }
+
+        String string()
+        {
+            return r.getString(read<uint32_t>());
+        }
+
+        template <class C>
+        void files(C &c)
+        {
+            auto n = count();
+            while (n--)
+                c.insert(string());
+        }
+    };
+
+    String getString(uint32_t id) const
+    {
+        if (id == explan_no_string)
+            return {};
+        if (id >= strings.size())
+            throw SW_RUNTIME_ERROR("Corrupted execution plan: bad string id");
+        return String(strings[id]);
+    }
+
+    // only structure is checked here, records are checked during decoding
+    void validate(const path &fn)
+    {
+        auto bad = [&fn](const String &what)
+        {
+            return SW_RUNTIME_ERROR("Bad execution plan " + to_string(fn) + ": " + what);
+        };
+        if (data.size() < sizeof(h))
+            throw bad("file is too small");
+        memcpy(&h, data.data(), sizeof(h));
+        if (memcmp(h.magic, explan_magic, sizeof(h.magic)) != 0)
+            throw bad("bad magic");
+        if (h.version != explan_version)
+            throw bad("version " + std::to_string(h.version) + " is not supported, expected " + std::to_string(explan_version) + ". Regenerate the plan");
+        if (h.size != data.size())
+            throw bad("size mismatch");
+        if (h.strings_offset < sizeof(h) || h.strings_offset > h.index_offset || h.index_offset > h.size)
+            throw bad("bad section offsets");
+        if ((h.size - h.index_offset) != (uint64_t)h.n_commands * sizeof(uint64_t))
+            throw bad("bad command index");
+
+        strings.reserve(h.n_strings);
+        Cursor r{ *this, h.strings_offset, h.index_offset };
+        for (uint32_t i = 0; i < h.n_strings; i++)
+        {
+            auto sz = r.read<uint32_t>();
+            if (r.pos + sz > h.index_offset)
+                throw bad("bad string table");
+            strings.emplace_back((const char *)&data[r.pos], sz);
+            r.pos += sz;
+        }
+        if (h.cwd >= strings.size())
+            throw bad("bad current path");
+
+        for (uint32_t i = 0; i < h.n_commands; i++)
+        {
+            uint64_t pos;
+            memcpy(&pos, &data[h.index_offset + i * sizeof(pos)], sizeof(pos));
+            if (pos < sizeof(h) || pos >= h.strings_offset)
+                throw bad("bad command offset");
+        }
+    }
+};
+
+// command from the binary plan, details are decoded on first use
+struct ExplanCommand : builder::Command
+{
+    ExplanCommand(std::shared_ptr<const ExplanReader> reader, size_t i)
+        : reader(std::move(reader))
+    {
+        std::tie(saved_hash, details) = this->reader->readPlan(*this, i);
+        // human readable explanations print full commands
+        if (Settings::get_user_settings().explain_outdated_full || Settings::get_user_settings().gExplainOutdatedToTrace)
+            loadDetails();
+    }
+
+    // program is resolved and listed in inputs when the plan is saved
+    void prepare() override
+    {
+        prepared = true;
+    }
+
+    bool isOutdated() const override
+    {
+        if (!builder::Command::isOutdated())
+            return false;
+        loadDetails();
+        return true;
+    }
+
+    String getName() const override
+    {
+        if (name.empty())
+            loadDetails();
+        return builder::Command::getName();
+    }
+
+    Arguments &getArguments() override
+    {
+        loadDetails();
+        return builder::Command::getArguments();
+    }
+
+    const Arguments &getArguments() const override
+    {
+        loadDetails();
+        return builder::Command::getArguments();
+    }
+
+private:
+    std::shared_ptr<const ExplanReader> reader;
+    uint64_t details = 0;
+    size_t saved_hash = 0;
+    mutable std::once_flag details_loaded;
+
+    size_t getHash1() const override
+    {
+        return saved_hash;
+    }
+
+    void loadDetails() const
+    {
+        std::call_once(details_loaded, [this]
+        {
+            reader->readDetails(*(ExplanCommand *)this, details);
+        });
+    }
+};
+
+}
+
+Commands ExecutionPlan::load(const path &p, const SwBuilderContext &swctx, int type)
+{
+    Commands commands;
+
+    // type is detected from the file, old text plans are still loadable
+    if (ExplanReader::isExplan(p))
+    {
+        // reader is shared by commands, details are decoded from it when needed
+        auto r = std::make_shared<const ExplanReader>(p);
+        fs::current_path(r->getCurrentPath());
+        commands.reserve(r->size());
+        for (size_t i = 0; i < r->size(); i++)
+            commands.insert(std::make_shared<ExplanCommand>(r, i));
+    }
+    else
+    {
         std::ifstream ifs(p);
         if (!ifs)
-            throw SW_RUNTIME_ERROR("Cannot read file: " + to_string(p));
+            throw SW_RUNTIME_ERROR("Cannot read file: " + to_string(p));
         boost::archive::text_iarchive ar(ifs);
-        load(ar);
+        path cp;
+        ar >> cp;
+        fs::current_path(cp);
+        ar >> commands;
     }
 
     // some setup
     for (auto &c : commands)
     {
         c->setContext(swctx);
-        c->command_storage = &swctx.getCommandStorage(c->command_storage_root);
+        if (!c->command_storage_root.empty())
+            c->command_storage = &swctx.getCommandStorage(c->command_storage_root);
+        else
+            c->command_storage = nullptr;
     }
     return commands;
 }
@@ -160,29 +577,28 @@ void ExecutionPlan::save(const path &p, int type) const
 {
     fs::create_directories(p.parent_path());
 
-    auto save = [this](auto &ar)
-    {
-        ar << fs::current_path();
-        ar << commands;
-    };
-
-    type = 1;
     if (type == 0)
-    {
+    {
+        ExplanWriter w;
+        for (auto &c : commands)
+            w.writeCommand(static_cast<builder::Command &>(*c));
+        w.finish(fs::current_path());
         std::ofstream ofs(p, std::ios_base::out | std::ios_base::binary);
         if (!ofs)
-            throw SW_RUNTIME_ERROR("Cannot write file: " + to_string(p));
-        boost::archive::binary_oarchive ar(ofs);
-        save(ar);
+            throw SW_RUNTIME_ERROR("Cannot write file: " + to_string(p));
+        ofs.write((const char *)w.data.data(), w.data.size());
     }
     else if (type == 1)
-    {
+    {
         std::ofstream ofs(p);
         if (!ofs)
-            throw SW_RUNTIME_ERROR("Cannot write file: " + to_string(p));
+            throw SW_RUNTIME_ERROR("Cannot write file: " + to_string(p));
         boost::archive::text_oarchive ar(ofs);
-        save(ar);
+        ar << fs::current_path();
+        ar << commands;
     }
+    else
+        throw SW_RUNTIME_ERROR("Unknown execution plan type: " + std::to_string(type));
 }
 
 }
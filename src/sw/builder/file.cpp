@@ -64,6 +64,190 @@ void explainMessage(const String &subject, bool outdated, const String &reason,
     });
 }
 
+String toString(ExplainReason r)
+{
+    switch (r)
+    {
+    case ExplainReason::AlwaysBuild:
+        return "always_build";
+    case ExplainReason::NoCommandStorage:
+        return "no_command_storage";
+    case ExplainReason::NewCommand:
+        return "new_command";
+    case ExplainReason::InputChanged:
+        return "input_changed";
+    case ExplainReason::InputMissing:
+        return "input_missing";
+    case ExplainReason::OutputChanged:
+        return "output_changed";
+    case ExplainReason::OutputMissing:
+        return "output_missing";
+    case ExplainReason::ImplicitInputChanged:
+        return "implicit_input_changed";
+    case ExplainReason::ImplicitInputMissing:
+        return "implicit_input_missing";
+    }
+    throw SW_RUNTIME_ERROR("Unknown explain reason: " + std::to_string((int)r));
+}
+
+path getExplainLogFile(const path &build_dir)
+{
+    return build_dir / "misc" / "explain.jsonl";
+}
+
+static void appendJsonString(String &s, const String &v)
+{
+    s += '"';
+    for (auto c : v)
+    {
+        switch (c)
+        {
+        case '"':
+            s += "\\\"";
+            break;
+        case '\\':
+            s += "\\\\";
+            break;
+        case '\n':
+            s += "\\n";
+            break;
+        case '\r':
+            s += "\\r";
+            break;
+        case '\t':
+            s += "\\t";
+            break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)c);
+                s += buf;
+            }
+            else
+                s += c;
+            break;
+        }
+    }
+    s += '"';
+}
+
+namespace
+{
+
+// records are collected in memory and written by big chunks
+// log is opened by every build, so it always describes the last build of its build dir
+struct ExplainLog
+{
+    static constexpr size_t flush_threshold = 1 << 16;
+
+    std::mutex m;
+    String buf;
+    std::ofstream o;
+    path fn;
+    int users = 0; // nested builds of the same dir share the log
+
+    ~ExplainLog()
+    {
+        std::unique_lock lk(m);
+        flush();
+    }
+
+    void open(const path &build_dir)
+    {
+        auto f = getExplainLogFile(build_dir);
+        std::unique_lock lk(m);
+        if (users++ && f == fn)
+            return;
+        flush();
+        o.close();
+        fn = f;
+        fs::create_directories(fn.parent_path());
+        o.open(fn, std::ios::binary | std::ios::trunc);
+        buf.reserve(flush_threshold * 2);
+    }
+
+    void close()
+    {
+        std::unique_lock lk(m);
+        flush();
+        if (users && --users == 0)
+        {
+            o.close();
+            fn.clear();
+        }
+    }
+
+    void add(const String &s)
+    {
+        std::unique_lock lk(m);
+        // records outside of builds are not logged
+        if (!users)
+            return;
+        buf += s;
+        if (buf.size() > flush_threshold)
+            flush();
+    }
+
+private:
+    void flush()
+    {
+        if (buf.empty())
+            return;
+        o.write(buf.data(), buf.size());
+        o.flush();
+        buf.clear();
+    }
+};
+
+static ExplainLog &getExplainLog()
+{
+    static ExplainLog log;
+    return log;
+}
+
+static bool isExplainLogNeeded()
+{
+    return sw::Settings::get_user_settings().explain_outdated
+        || sw::Settings::get_user_settings().explain_outdated_full
+        || sw::Settings::get_user_settings().gExplainOutdatedToTrace;
+}
+
+}
+
+void openExplainLog(const path &build_dir)
+{
+    if (isExplainLogNeeded())
+        getExplainLog().open(build_dir);
+}
+
+void closeExplainLog()
+{
+    if (isExplainLogNeeded())
+        getExplainLog().close();
+}
+
+void explainRecord(size_t hash, ExplainReason reason, const String &name, const path &p)
+{
+    auto &log = getExplainLog();
+
+    String s;
+    s.reserve(128 + name.size());
+    s += "{\"hash\":";
+    s += std::to_string(hash);
+    s += ",\"reason\":\"";
+    s += toString(reason);
+    s += "\",\"name\":";
+    appendJsonString(s, name);
+    if (!p.empty())
+    {
+        s += ",\"path\":";
+        appendJsonString(s, to_string(normalize_path(p)));
+    }
+    s += "}\n";
+    log.add(s);
+}
+
 FileData::FileData(const FileData &rhs)
 {
     *this = rhs;
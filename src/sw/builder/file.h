@@ -100,4 +100,34 @@ private:
 
 void explainMessage(const String &subject, bool outdated, const String &reason, const String &name);
 
+enum class ExplainReason : uint8_t
+{
+    AlwaysBuild,
+    NoCommandStorage,
+    NewCommand,
+    InputChanged,
+    InputMissing,
+    OutputChanged,
+    OutputMissing,
+    ImplicitInputChanged,
+    ImplicitInputMissing,
+};
+
+SW_BUILDER_API
+String toString(ExplainReason);
+
+SW_BUILDER_API
+path getExplainLogFile(const path &build_dir);
+
+// explain log of a build, previous log of the build dir is truncated on open
+// does nothing when explanations are not requested
+SW_BUILDER_API
+void openExplainLog(const path &build_dir);
+// writes all pending records
+SW_BUILDER_API
+void closeExplainLog();
+
+// one json line per outdated command, cheap enough to be always on with explain
+void explainRecord(size_t hash, ExplainReason reason, const String &name, const path &p = {});
+
 }
@@ -19,6 +19,7 @@
 #include "file_storage.h"
 
 #include "file.h"
+#include "file_watcher.h"
 #include "sw_context.h"
 
 #include <primitives/log.h>
@@ -27,6 +28,14 @@ DECLARE_STATIC_LOGGER(logger, "file_storage");
 namespace sw
 {
 
+FileStorage::FileStorage()
+{
+}
+
+FileStorage::~FileStorage()
+{
+}
+
 void FileStorage::clear()
 {
     files.clear();
@@ -38,12 +47,38 @@ void FileStorage::reset()
         f.reset();
 }
 
+void FileStorage::startWatcher()
+{
+    if (watcher || !FileWatcher::isSupported())
+        return;
+    try
+    {
+        watcher = std::make_unique<FileWatcher>(*this);
+    }
+    catch (std::exception &e)
+    {
+        LOG_WARN(logger, "File watcher is not started: " << e.what());
+    }
+}
+
+void FileStorage::resetChanged()
+{
+    if (!watcher)
+        return reset();
+    watcher->update();
+}
+
 FileData &FileStorage::registerFile(const path &in_f)
 {
     auto p = normalize_path(in_f);
     auto d = files.insert(p);
     if (d.second)
+    {
+        // watch first, so changes after refresh are not lost
+        if (watcher)
+            watcher->add(p, *d.first);
         d.first->refresh(in_f);
+    }
     return *d.first;
 }
 
@@ -26,6 +26,7 @@ namespace sw
 {
 
 struct FileData;
+struct FileWatcher;
 struct SwBuilderContext;
 
 struct SW_BUILDER_API FileStorage
@@ -34,10 +35,21 @@ struct SW_BUILDER_API FileStorage
 
     FileDataHashMap files;
 
+    FileStorage();
+    ~FileStorage();
+
     void clear(); // remove?
     void reset(); // remove?
 
+    /// watch for changes of registered files, call on empty storage
+    void startWatcher();
+    /// reset only changed files when watcher is running
+    void resetChanged();
+
     FileData &registerFile(const path &f);
+
+private:
+    std::unique_ptr<FileWatcher> watcher;
 };
 
 }
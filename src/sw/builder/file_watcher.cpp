@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "file_watcher.h"
+
+#include "file.h"
+#include "file_storage.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "file_watcher");
+
+namespace sw
+{
+
+#ifdef __linux__
+static const uint32_t watch_mask =
+    IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO |
+    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+#endif
+
+bool FileWatcher::isSupported()
+{
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FileWatcher::Directory::reset()
+{
+    for (auto &[_, f] : files)
+        f->reset();
+}
+
+FileWatcher::FileWatcher(FileStorage &fs)
+    : fs(fs)
+{
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1)
+        throw SW_RUNTIME_ERROR("Cannot init inotify: " + std::to_string(errno));
+#else
+    throw SW_RUNTIME_ERROR("File watcher is not supported on this platform");
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    if (fd != -1)
+        close(fd);
+#endif
+}
+
+void FileWatcher::add(const path &file, FileData &d)
+{
+    auto dir = file.parent_path();
+    std::unique_lock lk(m);
+    auto [i, inserted] = dirs.try_emplace(dir);
+    auto &di = i->second;
+    di.files[to_string(file.filename())] = &d;
+    if (!inserted)
+        return;
+    di.dir = dir;
+    watch(di);
+}
+
+void FileWatcher::watch(Directory &d)
+{
+#ifdef __linux__
+    d.wd = inotify_add_watch(fd, d.dir.string().c_str(), watch_mask);
+    if (d.wd == -1)
+    {
+        // missing dir or out of watches
+        if (errno != ENOENT)
+            LOG_TRACE(logger, "Cannot watch " << to_string(d.dir) << ": " << errno);
+        unwatched.insert(&d);
+        return;
+    }
+    // same dir by different path
+    auto &p = wds[d.wd];
+    if (p && p != &d)
+        unwatched.insert(&d);
+    else
+        p = &d;
+#endif
+}
+
+void FileWatcher::update()
+{
+#ifdef __linux__
+    std::unique_lock lk(m);
+
+    bool overflow = false;
+    size_t n = 0;
+    alignas(inotify_event) char buf[64 * 1024];
+    while (1)
+    {
+        auto r = read(fd, buf, sizeof(buf));
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        for (char *p = buf; p < buf + r; p += sizeof(inotify_event) + ((inotify_event *)p)->len)
+        {
+            auto e = (inotify_event *)p;
+            n++;
+            if (e->mask & IN_Q_OVERFLOW)
+            {
+                overflow = true;
+                continue;
+            }
+            auto i = wds.find(e->wd);
+            if (i == wds.end())
+                continue;
+            auto &d = *i->second;
+            if (e->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            {
+                d.reset();
+                if (!(e->mask & IN_IGNORED))
+                    inotify_rm_watch(fd, d.wd); // following IN_IGNORED is skipped
+                wds.erase(i);
+                d.wd = -1;
+                unwatched.insert(&d);
+                continue;
+            }
+            if (!e->len)
+                continue;
+            auto f = d.files.find(e->name);
+            if (f != d.files.end())
+                f->second->reset();
+        }
+    }
+
+    // retry, files will be refreshed until the dir is watched
+    auto retry = std::move(unwatched);
+    unwatched.clear();
+    for (auto d : retry)
+    {
+        d->reset();
+        watch(*d);
+    }
+
+    if (overflow)
+    {
+        LOG_DEBUG(logger, "File watcher queue overflow, rescanning all files");
+        fs.reset();
+    }
+    LOG_TRACE(logger, "File watcher: " << n << " events, " << unwatched.size() << " unwatched dirs");
+#endif
+}
+
+}
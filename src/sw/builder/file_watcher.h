@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace sw
+{
+
+struct FileData;
+struct FileStorage;
+
+// Watches directories of registered files (inotify).
+// Events are applied in update(): changed files are marked for refresh.
+// Files in directories that cannot be watched are refreshed on every update.
+struct SW_BUILDER_API FileWatcher
+{
+    FileWatcher(FileStorage &);
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+    ~FileWatcher();
+
+    // call before the first refresh of the file
+    void add(const path &file, FileData &);
+
+    // drain pending events, on queue overflow all files are refreshed
+    void update();
+
+    static bool isSupported();
+
+private:
+    struct Directory
+    {
+        path dir;
+        int wd = -1;
+        std::unordered_map<String, FileData *> files;
+
+        void reset();
+    };
+
+    FileStorage &fs;
+    int fd = -1;
+    std::mutex m;
+    std::unordered_map<path, Directory> dirs;
+    std::unordered_map<int, Directory *> wds;
+    std::unordered_set<Directory *> unwatched;
+
+    void watch(Directory &);
+};
+
+}
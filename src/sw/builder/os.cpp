@@ -26,6 +26,8 @@
 
 #ifdef CPPAN_OS_WINDOWS_NO_CYGWIN
 #include <windows.h>
+#else
+#include <unistd.h>
 #endif
 
 #include <primitives/log.h>
@@ -128,6 +130,25 @@ const OS &getHostOS()
     return os;
 }
 
+uint64_t getHostPhysicalMemory()
+{
+#ifdef CPPAN_OS_WINDOWS_NO_CYGWIN
+    MEMORYSTATUSEX s = { 0 };
+    s.dwLength = sizeof(s);
+    if (GlobalMemoryStatusEx(&s))
+        return s.ullTotalPhys;
+    return 0;
+#elif defined(_SC_PHYS_PAGES)
+    auto pages = sysconf(_SC_PHYS_PAGES);
+    auto page_size = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page_size > 0)
+        return (uint64_t)pages * page_size;
+    return 0;
+#else
+    return 0;
+#endif
+}
+
 bool OS::isMingwShell()
 {
     static auto is_mingw_shell = getenv("MSYSTEM");
@@ -269,4 +269,8 @@ struct SW_BUILDER_API OS
 SW_BUILDER_API
 const OS &getHostOS();
 
+/// total amount of physical memory in bytes, 0 if unknown
+SW_BUILDER_API
+uint64_t getHostPhysicalMemory();
+
 }
@@ -18,6 +18,7 @@
 
 #include "sw_context.h"
 
+#include "command.h"
 #include "command_storage.h"
 #include "file_storage.h"
 
@@ -46,11 +47,15 @@ SwBuilderContext::~SwBuilderContext()
 
 Executor &SwBuilderContext::getFileStorageExecutor() const
 {
+    if (storage_ctx)
+        return storage_ctx->getFileStorageExecutor();
     return *file_storage_executor;
 }
 
 FileStorage &SwBuilderContext::getFileStorage() const
 {
+    if (storage_ctx)
+        return storage_ctx->getFileStorage();
     if (!file_storage)
         file_storage = std::make_unique<FileStorage>();
     return *file_storage;
@@ -58,6 +63,8 @@ FileStorage &SwBuilderContext::getFileStorage() const
 
 CommandStorage &SwBuilderContext::getCommandStorage(const path &root) const
 {
+    if (storage_ctx)
+        return storage_ctx->getCommandStorage(root);
     std::unique_lock lk(csm);
     auto &cs = command_storages[root];
     if (!cs)
@@ -76,5 +83,15 @@ void SwBuilderContext::clearCommandStorages()
     command_storages.clear();
 }
 
+void SwBuilderContext::setStorageContext(const SwBuilderContext &ctx)
+{
+    storage_ctx = &ctx;
+}
+
+void SwBuilderContext::setRemoteExecutor(std::unique_ptr<builder::RemoteExecutor> e)
+{
+    remote_executor = std::move(e);
+}
+
 }
 
@@ -32,6 +32,7 @@ struct CommandStorage;
 struct FileStorage;
 
 namespace builder::detail { struct ResolvableCommand; }
+namespace builder { struct RemoteExecutor; }
 
 struct SW_BUILDER_API SwBuilderContext
 {
@@ -45,7 +46,16 @@ struct SW_BUILDER_API SwBuilderContext
     void clearFileStorages();
     void clearCommandStorages();
 
+    /// use storages of a long living context (resident daemon)
+    void setStorageContext(const SwBuilderContext &);
+
+    /// execute commands remotely when possible
+    void setRemoteExecutor(std::unique_ptr<builder::RemoteExecutor>);
+    builder::RemoteExecutor *getRemoteExecutor() const { return remote_executor.get(); }
+
 private:
+    const SwBuilderContext *storage_ctx = nullptr;
+    std::unique_ptr<builder::RemoteExecutor> remote_executor;
     // keep order
     mutable std::unordered_map<path, std::unique_ptr<CommandStorage>> command_storages;
     mutable std::unique_ptr<FileStorage> file_storage;
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "time_trace.h"
+
+namespace sw
+{
+
+TimeTrace::Scope::Scope(const String &name, const String &cat)
+{
+    if (!get().isEnabled())
+        return;
+    this->name = name;
+    this->cat = cat;
+    begin = Clock::now();
+}
+
+TimeTrace::Scope::~Scope()
+{
+    if (name.empty())
+        return;
+    get().addEvent(name, cat, begin, Clock::now());
+}
+
+TimeTrace &TimeTrace::get()
+{
+    static TimeTrace t;
+    return t;
+}
+
+void TimeTrace::reset()
+{
+    enabled = false;
+    std::unique_lock lk(m);
+    events.clear();
+    counters.clear();
+}
+
+void TimeTrace::addEvent(const String &name, const String &cat, Clock::time_point begin, Clock::time_point end)
+{
+    if (!enabled)
+        return;
+    Event e;
+    e.name = name;
+    e.cat = cat;
+    e.begin = begin;
+    e.end = end;
+    e.tid = std::this_thread::get_id();
+    std::unique_lock lk(m);
+    events.push_back(std::move(e));
+}
+
+void TimeTrace::setCounter(const String &name, int64_t value)
+{
+    if (!enabled)
+        return;
+    std::unique_lock lk(m);
+    counters[name] = value;
+    addCounterEvent(name, value);
+}
+
+void TimeTrace::addCounter(const String &name, int64_t delta)
+{
+    if (!enabled)
+        return;
+    std::unique_lock lk(m);
+    auto &v = counters[name];
+    v += delta;
+    addCounterEvent(name, v);
+}
+
+void TimeTrace::addCounterEvent(const String &name, int64_t value)
+{
+    Event e;
+    e.name = name;
+    e.cat = "counter";
+    e.begin = e.end = Clock::now();
+    e.counter = true;
+    e.value = value;
+    events.push_back(std::move(e));
+}
+
+std::vector<TimeTrace::Event> TimeTrace::getEvents() const
+{
+    std::unique_lock lk(m);
+    return events;
+}
+
+}
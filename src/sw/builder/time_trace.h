@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace sw
+{
+
+// Process wide recorder of phase events and counters for the chrome trace.
+// Nothing is recorded until enabled.
+struct SW_BUILDER_API TimeTrace
+{
+    using Clock = std::chrono::high_resolution_clock; // same as in commands
+
+    struct Event
+    {
+        String name;
+        String cat;
+        Clock::time_point begin;
+        Clock::time_point end;
+        std::thread::id tid;
+        bool counter = false;
+        int64_t value = 0;
+    };
+
+    struct SW_BUILDER_API Scope
+    {
+        Scope(const String &name, const String &cat = "build");
+        Scope(const Scope &) = delete;
+        ~Scope();
+
+    private:
+        String name;
+        String cat;
+        Clock::time_point begin;
+    };
+
+    static TimeTrace &get();
+
+    void enable(bool e = true) { enabled = e; }
+    bool isEnabled() const { return enabled; }
+    // drops recorded data and disables recording, trace is per build
+    void reset();
+
+    void addEvent(const String &name, const String &cat, Clock::time_point begin, Clock::time_point end);
+    void setCounter(const String &name, int64_t value);
+    void addCounter(const String &name, int64_t delta);
+
+    std::vector<Event> getEvents() const;
+
+private:
+    std::atomic_bool enabled{ false };
+    mutable std::mutex m;
+    std::vector<Event> events;
+    std::unordered_map<String, int64_t> counters;
+
+    void addCounterEvent(const String &name, int64_t value);
+};
+
+}
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "blob_store.h"
+
+#include <grpcpp/grpcpp.h>
+#include <primitives/exceptions.h>
+#include <primitives/hash.h>
+
+#include <thread>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "builder.distributed.blobs");
+
+// keep single calls reasonably small
+#define MAX_BATCH_SIZE (32 * 1024 * 1024)
+
+namespace sw::builder::distributed
+{
+
+BlobStore::BlobStore(const path &root)
+    : root(root)
+{
+    fs::create_directories(root);
+}
+
+String BlobStore::getHash(const String &data)
+{
+    return blake2b_512(data);
+}
+
+path BlobStore::getPath(const String &hash) const
+{
+    if (hash.size() < 3 || hash.find_first_not_of("0123456789abcdefABCDEF") != hash.npos)
+        throw SW_RUNTIME_ERROR("Bad blob hash: " + hash);
+    return root / hash.substr(0, 2) / hash;
+}
+
+bool BlobStore::has(const String &hash) const
+{
+    return fs::exists(getPath(hash));
+}
+
+String BlobStore::get(const String &hash) const
+{
+    auto p = getPath(hash);
+    if (!fs::exists(p))
+        throw SW_RUNTIME_ERROR("Missing blob: " + hash);
+    return read_file(p);
+}
+
+String BlobStore::put(const String &data)
+{
+    auto h = getHash(data);
+    put(h, data);
+    return h;
+}
+
+void BlobStore::put(const String &hash, const String &data)
+{
+    auto p = getPath(hash);
+    if (fs::exists(p))
+        return;
+    if (getHash(data) != hash)
+        throw SW_RUNTIME_ERROR("Blob hash mismatch: " + hash);
+    fs::create_directories(p.parent_path());
+    // atomic for concurrent puts
+    auto tmp = path(p) += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    write_file(tmp, data);
+    error_code ec;
+    fs::rename(tmp, p, ec);
+    if (ec)
+        fs::remove(tmp, ec);
+}
+
+String BlobStore::hashFile(const path &p)
+{
+    auto mtime = fs::last_write_time(p);
+    auto size = fs::file_size(p);
+    {
+        std::unique_lock lk(m);
+        auto i = file_hashes.find(p);
+        if (i != file_hashes.end() && i->second.mtime == mtime && i->second.size == size)
+            return i->second.hash;
+    }
+    auto h = getHash(read_file(p));
+    std::unique_lock lk(m);
+    file_hashes[p] = { mtime, size, h };
+    return h;
+}
+
+::sw::api::build::FileRef BlobStore::addFile(const path &p)
+{
+    ::sw::api::build::FileRef r;
+    r.set_path(to_string(normalize_path(p)));
+    auto h = hashFile(p);
+    if (!has(h))
+        put(h, read_file(p));
+    r.set_hash(h);
+    return r;
+}
+
+void BlobStore::materialize(const ::sw::api::build::FileRef &f)
+{
+    materialize(f, fs::u8path(f.path()));
+}
+
+void BlobStore::materialize(const ::sw::api::build::FileRef &f, const path &p)
+{
+    if (fs::exists(p) && hashFile(p) == f.hash())
+        return;
+    fs::create_directories(p.parent_path());
+    write_file(p, get(f.hash()));
+}
+
+DEFINE_SERVICE_METHOD(BlobService, FindMissingBlobs, ::sw::api::build::BlobHashes, ::sw::api::build::BlobHashes)
+{
+    try
+    {
+        for (auto &h : request->hashes())
+        {
+            if (!store.has(h))
+                response->add_hashes(h);
+        }
+    }
+    catch (std::exception &e)
+    {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+    }
+    GRPC_RETURN_OK();
+}
+
+DEFINE_SERVICE_METHOD(BlobService, PutBlobs, ::sw::api::build::Blobs, ::google::protobuf::Empty)
+{
+    try
+    {
+        for (auto &b : request->blobs())
+            store.put(b.hash(), b.data());
+    }
+    catch (std::exception &e)
+    {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+    }
+    GRPC_RETURN_OK();
+}
+
+DEFINE_SERVICE_METHOD(BlobService, GetBlobs, ::sw::api::build::BlobHashes, ::sw::api::build::Blobs)
+{
+    try
+    {
+        for (auto &h : request->hashes())
+        {
+            auto b = response->add_blobs();
+            b->set_hash(h);
+            b->set_data(store.get(h));
+        }
+    }
+    catch (std::exception &e)
+    {
+        return grpc::Status(grpc::StatusCode::NOT_FOUND, e.what());
+    }
+    GRPC_RETURN_OK();
+}
+
+static Strings findMissing(::sw::api::build::BlobService::Stub &stub, const Strings &hashes)
+{
+    auto stub_ptr = &stub;
+    ::sw::api::build::BlobHashes request;
+    for (auto &h : hashes)
+        request.add_hashes(h);
+    auto context = std::make_unique<grpc::ClientContext>();
+    GRPC_CALL_THROWS(stub_ptr, FindMissingBlobs, ::sw::api::build::BlobHashes);
+    return { response.hashes().begin(), response.hashes().end() };
+}
+
+void uploadBlobs(BlobStore &store, ::sw::api::build::BlobService::Stub &stub, const Strings &hashes)
+{
+    auto stub_ptr = &stub;
+    auto missing = findMissing(stub, hashes);
+    ::sw::api::build::Blobs request;
+    size_t sz = 0;
+    auto flush = [&]()
+    {
+        if (request.blobs().empty())
+            return;
+        auto context = std::make_unique<grpc::ClientContext>();
+        GRPC_CALL_THROWS(stub_ptr, PutBlobs, ::google::protobuf::Empty);
+        request.clear_blobs();
+        sz = 0;
+    };
+    for (auto &h : missing)
+    {
+        auto b = request.add_blobs();
+        b->set_hash(h);
+        b->set_data(store.get(h));
+        sz += b->data().size();
+        if (sz > MAX_BATCH_SIZE)
+            flush();
+    }
+    flush();
+    if (!missing.empty())
+        LOG_TRACE(logger, "Uploaded " << missing.size() << " of " << hashes.size() << " blobs");
+}
+
+void downloadBlobs(BlobStore &store, ::sw::api::build::BlobService::Stub &stub, const Strings &hashes)
+{
+    auto stub_ptr = &stub;
+    ::sw::api::build::BlobHashes request;
+    for (auto &h : hashes)
+    {
+        if (!store.has(h))
+            request.add_hashes(h);
+    }
+    if (request.hashes().empty())
+        return;
+    auto context = std::make_unique<grpc::ClientContext>();
+    GRPC_CALL_THROWS(stub_ptr, GetBlobs, ::sw::api::build::Blobs);
+    for (auto &b : response.blobs())
+        store.put(b.hash(), b.data());
+    LOG_TRACE(logger, "Downloaded " << response.blobs().size() << " of " << hashes.size() << " blobs");
+}
+
+}
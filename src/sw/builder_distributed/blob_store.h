@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <sw/protocol/build.grpc.pb.h>
+#include <sw/protocol/grpc_helpers.h>
+
+#include <primitives/filesystem.h>
+
+#include <mutex>
+#include <unordered_map>
+
+namespace sw::builder::distributed
+{
+
+/// content addressed storage of files, keyed by blake2b-512 of contents
+struct SW_BUILDER_DISTRIBUTED_API BlobStore
+{
+    BlobStore(const path &root);
+
+    bool has(const String &hash) const;
+    String get(const String &hash) const;
+    /// returns hash
+    String put(const String &data);
+    void put(const String &hash, const String &data);
+
+    /// cached by mtime and size
+    String hashFile(const path &);
+    /// store file contents, returns ref to it
+    ::sw::api::build::FileRef addFile(const path &);
+    /// write blob to its path unless the file is already the same
+    void materialize(const ::sw::api::build::FileRef &);
+    /// write blob to another path
+    void materialize(const ::sw::api::build::FileRef &, const path &to);
+
+    const path &getRoot() const { return root; }
+
+    static String getHash(const String &data);
+
+private:
+    struct FileHash
+    {
+        fs::file_time_type mtime;
+        uintmax_t size;
+        String hash;
+    };
+
+    path root;
+    std::mutex m;
+    std::unordered_map<path, FileHash> file_hashes;
+
+    path getPath(const String &hash) const;
+};
+
+class BlobServiceImpl : public ::sw::api::build::BlobService::Service
+{
+public:
+    BlobServiceImpl(BlobStore &store) : store(store) {}
+
+private:
+    BlobStore &store;
+
+    DECLARE_SERVICE_METHOD(FindMissingBlobs, ::sw::api::build::BlobHashes, ::sw::api::build::BlobHashes);
+    DECLARE_SERVICE_METHOD(PutBlobs, ::sw::api::build::Blobs, ::google::protobuf::Empty);
+    DECLARE_SERVICE_METHOD(GetBlobs, ::sw::api::build::BlobHashes, ::sw::api::build::Blobs);
+};
+
+/// sends blobs missing on the other side
+SW_BUILDER_DISTRIBUTED_API
+void uploadBlobs(BlobStore &, ::sw::api::build::BlobService::Stub &, const Strings &hashes);
+
+/// receives blobs missing on our side
+SW_BUILDER_DISTRIBUTED_API
+void downloadBlobs(BlobStore &, ::sw::api::build::BlobService::Stub &, const Strings &hashes);
+
+}
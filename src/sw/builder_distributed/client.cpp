@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "client.h"
+
+#include <sw/builder/os.h>
+#include <sw/support/filesystem.h>
+
+#include <grpcpp/grpcpp.h>
+#include <primitives/exceptions.h>
+
+#include <algorithm>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "builder.distributed.client");
+
+namespace sw::builder::distributed
+{
+
+static grpc::ChannelArguments getChannelArguments()
+{
+    grpc::ChannelArguments args;
+    args.SetMaxReceiveMessageSize(-1);
+    return args;
+}
+
+Client::Client(const String &endpoint, const path &storage_root)
+    : Client(grpc::CreateCustomChannel(endpoint, grpc::InsecureChannelCredentials(), getChannelArguments()), storage_root)
+{
+    this->endpoint = endpoint;
+}
+
+Client::Client(const std::shared_ptr<grpc::Channel> &channel, const path &storage_root)
+    : endpoint("in-process")
+    , store(storage_root.empty() ? support::temp_directory_path() / "distributed" / "client" : storage_root)
+    , channel(channel)
+    , stub(::sw::api::build::DistributedBuildService::NewStub(channel))
+    , blobs(::sw::api::build::BlobService::NewStub(channel))
+{
+}
+
+Client::~Client()
+{
+}
+
+void Client::execute(const ::sw::api::build::Command &request, ::sw::api::build::CommandResult &response)
+{
+    Strings inputs;
+    for (auto &f : request.inputs())
+        inputs.push_back(f.hash());
+    uploadBlobs(store, *blobs, inputs);
+
+    grpc::ClientContext context;
+    auto s = stub->ExecuteCommand(&context, request, &response);
+    if (!s.ok())
+        throw SW_RUNTIME_ERROR("Remote execution failed: " + s.error_message());
+
+    Strings outputs;
+    for (auto &f : response.outputs())
+        outputs.push_back(f.hash());
+    downloadBlobs(store, *blobs, outputs);
+    for (auto &f : response.outputs())
+        store.materialize(f);
+}
+
+void Client::execute(const ::sw::api::build::Plan &plan, const std::function<void(const ::sw::api::build::PlanCommandResult &)> &h)
+{
+    Strings inputs;
+    for (auto &c : plan.commands())
+    {
+        for (auto &f : c.command().inputs())
+        {
+            if (!f.hash().empty())
+                inputs.push_back(f.hash());
+        }
+    }
+    uploadBlobs(store, *blobs, inputs);
+
+    grpc::ClientContext context;
+    auto reader = stub->ExecutePlan(&context, plan);
+    ::sw::api::build::PlanCommandResult r;
+    while (reader->Read(&r))
+    {
+        Strings outputs;
+        for (auto &f : r.result().outputs())
+            outputs.push_back(f.hash());
+        downloadBlobs(store, *blobs, outputs);
+        for (auto &f : r.result().outputs())
+            store.materialize(f);
+        h(r);
+    }
+    auto s = reader->Finish();
+    if (!s.ok())
+        throw SW_RUNTIME_ERROR("Remote plan execution failed: " + s.error_message());
+}
+
+void Client::cancel(const String &plan_id)
+{
+    ::sw::api::build::PlanId request;
+    request.set_id(plan_id);
+    auto context = std::make_unique<grpc::ClientContext>();
+    GRPC_SET_DEADLINE(10);
+    auto stub_ptr = stub.get();
+    GRPC_CALL_THROWS(stub_ptr, CancelPlan, ::google::protobuf::Empty);
+}
+
+void Client::addRoot(const path &p)
+{
+    roots.push_back(to_string(normalize_path(fs::absolute(p))));
+}
+
+bool Client::isUnderRoots(const path &p) const
+{
+    auto s = to_string(normalize_path(p));
+    auto under = [&s](const String &r)
+    {
+        return s.size() > r.size() && s.compare(0, r.size(), r) == 0 && s[r.size()] == '/';
+    };
+    if (roots.empty())
+        return under(to_string(normalize_path(fs::current_path())));
+    return std::any_of(roots.begin(), roots.end(), under);
+}
+
+// the command could not see some files, so its result says nothing
+static bool isMissingFileError(const String &s)
+{
+    return 0
+        || s.find("No such file or directory") != s.npos // gcc
+        || s.find("file not found") != s.npos // clang
+        || s.find("C1083") != s.npos // msvc: cannot open include file
+        ;
+}
+
+bool Client::execute(Command &c, const Files &additional_inputs)
+{
+    // files outside of roots (toolchain, system headers) are not sent,
+    // same layout of such paths is expected on the other side
+    ::sw::api::build::Command request;
+    for (auto &a : c.getArguments())
+        request.add_arguments(a->toString());
+    request.set_working_directory(to_string(normalize_path(c.working_directory)));
+    for (auto &[k, v] : c.environment)
+        (*request.mutable_environment())[k] = v;
+    request.mutable_in()->set_file(to_string(normalize_path(c.in.file)));
+    request.mutable_in()->set_text(c.in.text);
+    request.mutable_out()->set_file(to_string(normalize_path(c.out.file)));
+    request.mutable_err()->set_file(to_string(normalize_path(c.err.file)));
+    for (auto &o : c.outputs)
+        request.add_outputs(to_string(normalize_path(o)));
+    if (!c.deps_file.empty())
+    {
+        request.add_outputs(to_string(normalize_path(c.deps_file)));
+        request.set_deps_file(to_string(normalize_path(c.deps_file)));
+        // stale file of the previous local run must not be processed
+        error_code ec;
+        fs::remove(c.deps_file, ec);
+    }
+    request.set_os(toString(getHostOS().Type));
+    request.set_arch(toString(getHostOS().Arch));
+    if (roots.empty())
+        request.add_roots(to_string(normalize_path(fs::current_path())));
+    for (auto &r : roots)
+        request.add_roots(r);
+
+    try
+    {
+        // implicit inputs are known from the previous run,
+        // files included for the first time are missing there and the command is rerun locally
+        Files inputs = c.inputs;
+        inputs.insert(c.implicit_inputs.begin(), c.implicit_inputs.end());
+        inputs.insert(additional_inputs.begin(), additional_inputs.end());
+        if (!c.in.file.empty())
+            inputs.insert(c.in.file);
+        for (auto &i : inputs)
+        {
+            if (isUnderRoots(i) && fs::is_regular_file(i))
+                *request.add_inputs() = store.addFile(i);
+        }
+
+        ::sw::api::build::CommandResult response;
+        execute(request, response);
+        // not started there or inputs were incomplete (new includes), local run decides
+        if (response.exit_code() < 0
+            || response.exit_code() && (isMissingFileError(response.err()) || isMissingFileError(response.out())))
+        {
+            LOG_DEBUG(logger, "Remote run of " << c.getName() << " is inconclusive, running locally");
+            return false;
+        }
+
+        c.exit_code = response.exit_code();
+        c.out.text = response.out();
+        c.err.text = response.err();
+        LOG_TRACE(logger, "Executed " << c.getName() << (response.worker().empty() ? " on the server" : " on worker " + response.worker()));
+        return true;
+    }
+    catch (std::exception &e)
+    {
+        LOG_DEBUG(logger, "Cannot execute " << c.getName() << " on " << endpoint << ": " << e.what());
+        return false;
+    }
+}
+
+}
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include "blob_store.h"
+
+#include <sw/builder/command.h>
+
+#include <functional>
+#include <memory>
+
+namespace sw::builder::distributed
+{
+
+/// sends commands to the distributed build server
+struct SW_BUILDER_DISTRIBUTED_API Client : RemoteExecutor
+{
+    /// empty root - temp dir
+    Client(const String &endpoint, const path &storage_root = {});
+    Client(const std::shared_ptr<grpc::Channel> &, const path &storage_root = {});
+    ~Client();
+
+    bool execute(Command &, const Files &additional_inputs) override;
+
+    /// low level call, blobs of inputs must be in the store
+    void execute(const ::sw::api::build::Command &, ::sw::api::build::CommandResult &);
+
+    /// inputs with hashes must be in the store,
+    /// outputs are materialized before the handler is called
+    void execute(const ::sw::api::build::Plan &, const std::function<void(const ::sw::api::build::PlanCommandResult &)> &);
+    void cancel(const String &plan_id);
+
+    BlobStore &getStore() { return store; }
+
+    /// only files under roots are sent (sources, build dir, package storage),
+    /// no roots - current dir
+    void addRoot(const path &);
+
+private:
+    String endpoint;
+    std::vector<String> roots;
+    BlobStore store;
+    std::shared_ptr<grpc::Channel> channel;
+    std::unique_ptr<::sw::api::build::DistributedBuildService::Stub> stub;
+    std::unique_ptr<::sw::api::build::BlobService::Stub> blobs;
+
+    bool isUnderRoots(const path &) const;
+};
+
+}
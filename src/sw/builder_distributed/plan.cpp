@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "plan.h"
+
+#include <primitives/exceptions.h>
+
+#include <algorithm>
+#include <thread>
+#include <unordered_set>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "builder.distributed.plan");
+
+namespace sw::builder::distributed
+{
+
+PlanExecution::PlanExecution(const ::sw::api::build::Plan &plan, CommandExecutor executor)
+    : plan(plan)
+    , executor(std::move(executor))
+{
+    int n = plan.commands_size();
+    dependents.resize(n);
+    n_deps.resize(n);
+    states.resize(n, State::Pending);
+    for (int i = 0; i < n; i++)
+    {
+        for (auto d : plan.commands(i).dependencies())
+        {
+            if (d >= (uint32_t)n || d == (uint32_t)i)
+                throw SW_RUNTIME_ERROR("Bad dependency " + std::to_string(d) + " of plan command " + std::to_string(plan.commands(i).id()));
+            dependents[d].push_back(i);
+            n_deps[i]++;
+        }
+    }
+
+    // check for cycles
+    {
+        auto deps = n_deps;
+        std::vector<int> q;
+        for (int i = 0; i < n; i++)
+        {
+            if (!deps[i])
+                q.push_back(i);
+        }
+        int visited = 0;
+        while (!q.empty())
+        {
+            auto i = q.back();
+            q.pop_back();
+            visited++;
+            for (auto d : dependents[i])
+            {
+                if (!--deps[d])
+                    q.push_back(d);
+            }
+        }
+        if (visited != n)
+            throw SW_RUNTIME_ERROR("Plan has dependency cycles");
+    }
+
+    // partial resubmission
+    std::unordered_set<uint64_t> completed(plan.completed().begin(), plan.completed().end());
+    for (int i = 0; i < n; i++)
+    {
+        if (!completed.count(plan.commands(i).id()))
+            continue;
+        states[i] = State::Succeeded;
+        n_finished++;
+        for (auto d : dependents[i])
+            n_deps[d]--;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (states[i] == State::Pending && !n_deps[i])
+            ready.push_back(i);
+    }
+}
+
+void PlanExecution::run(const ResultHandler &h, int jobs)
+{
+    LOG_DEBUG(logger, "Executing plan " << plan.id() << ": " << states.size() << " commands, "
+        << n_finished << " completed earlier");
+    std::vector<std::thread> threads;
+    auto n = std::clamp<size_t>(jobs, 1, std::max<size_t>(states.size(), 1));
+    for (size_t i = 0; i < n; i++)
+        threads.emplace_back([this, &h] { loop(h); });
+    for (auto &t : threads)
+        t.join();
+}
+
+void PlanExecution::cancel()
+{
+    std::unique_lock lk(m);
+    if (!cancelled)
+        LOG_DEBUG(logger, "Plan " << plan.id() << " is cancelled");
+    cancelled = true;
+}
+
+void PlanExecution::loop(const ResultHandler &h)
+{
+    while (1)
+    {
+        std::unique_lock lk(m);
+        cv.wait(lk, [this] { return !ready.empty() || n_finished == states.size(); });
+        if (ready.empty())
+            return;
+        auto i = ready.front();
+        ready.pop_front();
+
+        Results rs;
+        if (cancelled || (failed && plan.stop_on_error()))
+            skip(i, rs);
+        else
+        {
+            states[i] = State::Running;
+            lk.unlock();
+            rs.resize(1);
+            auto ok = execute(i, rs[0]);
+            lk.lock();
+            complete(i, ok ? State::Succeeded : State::Failed, rs);
+        }
+        lk.unlock();
+        cv.notify_all();
+        emit(h, rs);
+    }
+}
+
+bool PlanExecution::execute(int i, ::sw::api::build::PlanCommandResult &r)
+{
+    auto &pc = plan.commands(i);
+    r.set_id(pc.id());
+    auto c = pc.command();
+    try
+    {
+        {
+            std::unique_lock lk(m);
+            for (auto &f : *c.mutable_inputs())
+            {
+                if (!f.hash().empty())
+                    continue;
+                auto o = outputs.find(f.path());
+                if (o == outputs.end())
+                    throw SW_RUNTIME_ERROR("Input is not produced by dependencies: " + f.path());
+                f.set_hash(o->second);
+            }
+        }
+        executor(c, *r.mutable_result());
+    }
+    catch (std::exception &e)
+    {
+        r.mutable_result()->set_exit_code(-1);
+        r.mutable_result()->set_err(e.what());
+    }
+    return r.result().exit_code() == 0;
+}
+
+void PlanExecution::complete(int i, State s, Results &rs)
+{
+    states[i] = s;
+    n_finished++;
+    if (s == State::Succeeded)
+    {
+        for (auto &o : rs[0].result().outputs())
+            outputs[o.path()] = o.hash();
+        for (auto d : dependents[i])
+        {
+            if (!--n_deps[d] && states[d] == State::Pending)
+                ready.push_back(d);
+        }
+        return;
+    }
+    failed = true;
+    for (auto d : dependents[i])
+        skip(d, rs);
+}
+
+void PlanExecution::skip(int i, Results &rs)
+{
+    // iterative, chains may be long
+    std::vector<int> q{ i };
+    while (!q.empty())
+    {
+        auto j = q.back();
+        q.pop_back();
+        if (states[j] != State::Pending)
+            continue;
+        states[j] = State::Skipped;
+        n_finished++;
+        auto &r = rs.emplace_back();
+        r.set_id(plan.commands(j).id());
+        r.set_skipped(true);
+        q.insert(q.end(), dependents[j].begin(), dependents[j].end());
+    }
+}
+
+void PlanExecution::emit(const ResultHandler &h, const Results &rs)
+{
+    std::unique_lock lk(hm);
+    for (auto &r : rs)
+    {
+        bool ok = false;
+        try
+        {
+            ok = h(r);
+        }
+        catch (std::exception &e)
+        {
+            LOG_DEBUG(logger, "Plan " << plan.id() << " result handler failed: " << e.what());
+        }
+        if (!ok)
+            cancel();
+    }
+}
+
+}
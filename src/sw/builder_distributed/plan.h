@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <sw/protocol/build.pb.h>
+
+#include <primitives/string.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace sw::builder::distributed
+{
+
+/// schedules commands of the plan by their dependencies
+struct SW_BUILDER_DISTRIBUTED_API PlanExecution
+{
+    using CommandExecutor = std::function<void(const ::sw::api::build::Command &, ::sw::api::build::CommandResult &)>;
+    /// return false to cancel the plan
+    using ResultHandler = std::function<bool(const ::sw::api::build::PlanCommandResult &)>;
+
+    /// throws on bad dependencies or cycles
+    PlanExecution(const ::sw::api::build::Plan &, CommandExecutor);
+
+    /// blocks until every command is completed or skipped, handler calls are serialized
+    void run(const ResultHandler &, int jobs);
+    /// running commands are completed, not started ones are skipped
+    void cancel();
+
+private:
+    enum class State
+    {
+        Pending,
+        Running,
+        Succeeded,
+        Failed,
+        Skipped,
+    };
+    using Results = std::vector<::sw::api::build::PlanCommandResult>;
+
+    const ::sw::api::build::Plan &plan;
+    CommandExecutor executor;
+    std::vector<std::vector<int>> dependents;
+    std::vector<int> n_deps; // not completed
+    std::vector<State> states;
+    std::deque<int> ready;
+    std::unordered_map<String, String> outputs; // path -> hash
+    size_t n_finished = 0;
+    bool cancelled = false;
+    bool failed = false;
+    std::mutex m;
+    std::condition_variable cv;
+    std::mutex hm;
+
+    void loop(const ResultHandler &);
+    bool execute(int i, ::sw::api::build::PlanCommandResult &);
+    void complete(int i, State, Results &);
+    void skip(int i, Results &);
+    void emit(const ResultHandler &, const Results &);
+};
+
+}
@@ -3,34 +3,90 @@
 
 #include "server.h"
 
-#include <sw/builder/command.h>
+#include "worker.h"
+
+#include <sw/support/filesystem.h>
 
 #include <grpcpp/grpcpp.h>
 #include <primitives/exceptions.h>
 
+#include <algorithm>
+#include <thread>
+
 #include <primitives/log.h>
 DECLARE_STATIC_LOGGER(logger, "builder.distributed.server");
 
-// move this just into builder itself?
+// worker is dropped after this number of failed calls in a row
+#define MAX_WORKER_FAILURES 3
 
 namespace sw::builder::distributed
 {
 
 DEFINE_SERVICE_METHOD(DistributedBuildService, ExecuteCommand, ::sw::api::build::Command, ::sw::api::build::CommandResult)
 {
-    // fan mode: send to workers in round robin mode
+    try
+    {
+        s.executeCommand(*request, *response);
+    }
+    catch (std::exception &e)
+    {
+        return grpc::Status(grpc::StatusCode::INTERNAL, e.what());
+    }
+    GRPC_RETURN_OK();
+}
+
+grpc::Status DistributedBuildServiceImpl::ExecutePlan(grpc::ServerContext *context, const ::sw::api::build::Plan *request,
+    grpc::ServerWriter<::sw::api::build::PlanCommandResult> *writer)
+{
+    try
+    {
+        // client is gone - stop the plan
+        s.executePlan(*request, [context, writer](auto &r)
+        {
+            return !context->IsCancelled() && writer->Write(r);
+        });
+    }
+    catch (std::exception &e)
+    {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+    }
+    GRPC_RETURN_OK();
+}
 
-    Command c;
-    c.in.file = fs::u8path(request->in().file());
-    c.in.file = fs::u8path(request->in().file());
-    c.in.file = fs::u8path(request->in().file());
+DEFINE_SERVICE_METHOD(DistributedBuildService, CancelPlan, ::sw::api::build::PlanId, ::google::protobuf::Empty)
+{
+    if (!s.cancelPlan(request->id()))
+        return grpc::Status(grpc::StatusCode::NOT_FOUND, "No such plan: " + request->id());
+    GRPC_RETURN_OK();
+}
 
-    c.execute();
+DEFINE_SERVICE_METHOD(DistributedBuildService, RegisterWorker, ::sw::api::build::WorkerInfo, ::sw::api::build::WorkerId)
+{
+    if (request->endpoint().empty())
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Empty worker endpoint");
+    if (request->capacity() < 1)
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Bad worker capacity");
+    response->set_id(s.registerWorker(*request));
+    GRPC_RETURN_OK();
+}
 
+DEFINE_SERVICE_METHOD(DistributedBuildService, UnregisterWorker, ::sw::api::build::WorkerId, ::google::protobuf::Empty)
+{
+    s.unregisterWorker(request->id());
     GRPC_RETURN_OK();
 }
 
-Server::Server()
+bool Worker::isCompatible(const ::sw::api::build::Command &c) const
+{
+    return
+        (c.os().empty() || c.os() == info.os()) &&
+        (c.arch().empty() || c.arch() == info.arch());
+}
+
+Server::Server(const path &storage_root)
+    : store(storage_root.empty() ? support::temp_directory_path() / "distributed" / "server" : storage_root)
+    , dbs(*this)
+    , bs(store)
 {
 }
 
@@ -38,22 +94,26 @@ Server::~Server()
 {
 }
 
-void Server::start(const String &server_address/*, const String &cert*/)
+int Server::start(const String &server_address/*, const String &cert*/)
 {
     grpc::SslServerCredentialsOptions ssl_options;
     //if (!cert.empty())
         //ssl_options.pem_key_cert_pairs.push_back({ read_file("server.key"), read_file("server.crt") });
 
+    int port = 0;
     grpc::ServerBuilder builder;
     //if (sw::settings().grpc_use_ssl)
         //builder.AddListeningPort(server_address, grpc::SslServerCredentials(ssl_options));
     //else
-    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials(), &port);
+    builder.SetMaxReceiveMessageSize(-1);
 
     builder.RegisterService(&dbs);
+    builder.RegisterService(&bs);
     server = builder.BuildAndStart();
     if (!server)
         throw SW_RUNTIME_ERROR("Cannot start grpc server");
+    return port;
 }
 
 void Server::wait()
@@ -70,4 +130,155 @@ void Server::stop()
     server->Shutdown();
 }
 
+std::shared_ptr<grpc::Channel> Server::getInProcessChannel() const
+{
+    if (!server)
+        throw SW_RUNTIME_ERROR("Server not started");
+    grpc::ChannelArguments args;
+    args.SetMaxReceiveMessageSize(-1);
+    return server->InProcessChannel(args);
+}
+
+String Server::registerWorker(const ::sw::api::build::WorkerInfo &info)
+{
+    grpc::ChannelArguments args;
+    args.SetMaxReceiveMessageSize(-1);
+    auto channel = grpc::CreateCustomChannel(info.endpoint(), grpc::InsecureChannelCredentials(), args);
+
+    auto w = std::make_shared<Worker>();
+    w->info = info;
+    w->stub = ::sw::api::build::WorkerService::NewStub(channel);
+    w->blobs = ::sw::api::build::BlobService::NewStub(channel);
+
+    std::unique_lock lk(m);
+    w->id = std::to_string(++next_worker_id);
+    workers.push_back(w);
+    LOG_INFO(logger, "Worker " << w->id << " registered: " << info.endpoint() << ", capacity " << info.capacity()
+        << ", " << info.os() << " " << info.arch());
+    return w->id;
+}
+
+void Server::unregisterWorker(const String &id)
+{
+    std::unique_lock lk(m);
+    auto i = std::find_if(workers.begin(), workers.end(), [&id](auto &w) { return w->id == id; });
+    if (i == workers.end())
+        return;
+    workers.erase(i);
+    LOG_INFO(logger, "Worker " << id << " unregistered");
+}
+
+size_t Server::getNumberOfWorkers() const
+{
+    std::unique_lock lk(m);
+    return workers.size();
+}
+
+int Server::getCapacity() const
+{
+    std::unique_lock lk(m);
+    int n = 0;
+    for (auto &w : workers)
+        n += w->info.capacity();
+    return n ? n : (int)std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::shared_ptr<Worker> Server::selectWorker(const ::sw::api::build::Command &c) const
+{
+    std::unique_lock lk(m);
+    std::shared_ptr<Worker> r;
+    for (auto &w : workers)
+    {
+        if (!w->isCompatible(c))
+            continue;
+        if (!r || w->getLoad() < r->getLoad())
+            r = w;
+    }
+    // reserve a slot while under lock, so parallel calls spread
+    if (r)
+        r->active++;
+    return r;
+}
+
+void Server::executeCommand(const ::sw::api::build::Command &request, ::sw::api::build::CommandResult &response)
+{
+    Strings inputs;
+    for (auto &f : request.inputs())
+        inputs.push_back(f.hash());
+
+    // try another worker once
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        auto w = selectWorker(request);
+        if (!w)
+            break;
+        SCOPE_EXIT
+        {
+            w->active--;
+        };
+
+        try
+        {
+            uploadBlobs(store, *w->blobs, inputs);
+
+            response.Clear();
+            grpc::ClientContext context;
+            auto s = w->stub->ExecuteCommand(&context, request, &response);
+            if (!s.ok())
+                throw SW_RUNTIME_ERROR(s.error_message());
+
+            Strings outputs;
+            for (auto &f : response.outputs())
+                outputs.push_back(f.hash());
+            downloadBlobs(store, *w->blobs, outputs);
+
+            w->failures = 0;
+            response.set_worker(w->id);
+            return;
+        }
+        catch (std::exception &e)
+        {
+            LOG_WARN(logger, "Worker " << w->id << " (" << w->info.endpoint() << ") failed: " << e.what());
+            if (++w->failures >= MAX_WORKER_FAILURES)
+                unregisterWorker(w->id);
+        }
+    }
+
+    // no workers or all of them failed
+    response.Clear();
+    for (auto &f : request.inputs())
+    {
+        if (!store.has(f.hash()))
+            throw SW_RUNTIME_ERROR("Missing input blob: " + f.path());
+    }
+    distributed::executeCommand(store, request, response);
+}
+
+void Server::executePlan(const ::sw::api::build::Plan &plan, const PlanExecution::ResultHandler &h)
+{
+    PlanExecution e(plan, [this](auto &c, auto &r) { executeCommand(c, r); });
+    if (!plan.id().empty())
+    {
+        std::unique_lock lk(m);
+        if (!plans.emplace(plan.id(), &e).second)
+            throw SW_RUNTIME_ERROR("Plan is already running: " + plan.id());
+    }
+    SCOPE_EXIT
+    {
+        std::unique_lock lk(m);
+        plans.erase(plan.id());
+    };
+    e.run(h, getCapacity());
+}
+
+bool Server::cancelPlan(const String &id)
+{
+    std::unique_lock lk(m);
+    auto i = plans.find(id);
+    if (i == plans.end())
+        return false;
+    i->second->cancel();
+    return true;
+}
+
 }
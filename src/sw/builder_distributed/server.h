@@ -3,51 +3,95 @@
 
 #pragma once
 
+#include "blob_store.h"
+#include "plan.h"
+
 #include <sw/protocol/build.grpc.pb.h>
 #include <sw/protocol/grpc_helpers.h>
 
 #include <grpcpp/server.h>
 #include <primitives/string.h>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace sw::builder::distributed
 {
 
+struct Server;
+
 class DistributedBuildServiceImpl : public ::sw::api::build::DistributedBuildService::Service
 {
-    DECLARE_SERVICE_METHOD(ExecuteCommand, ::sw::api::build::Command, ::sw::api::build::CommandResult);
-};
+public:
+    DistributedBuildServiceImpl(Server &s) : s(s) {}
 
-struct SW_BUILDER_DISTRIBUTED_API Client
-{
-
-};
+private:
+    Server &s;
 
-struct SW_BUILDER_DISTRIBUTED_API Session
-{
-    std::unique_ptr<Client> client;
+    DECLARE_SERVICE_METHOD(ExecuteCommand, ::sw::api::build::Command, ::sw::api::build::CommandResult);
+    DECLARE_SERVICE_METHOD(CancelPlan, ::sw::api::build::PlanId, ::google::protobuf::Empty);
+    DECLARE_SERVICE_METHOD(RegisterWorker, ::sw::api::build::WorkerInfo, ::sw::api::build::WorkerId);
+    DECLARE_SERVICE_METHOD(UnregisterWorker, ::sw::api::build::WorkerId, ::google::protobuf::Empty);
+
+    grpc::Status ExecutePlan(grpc::ServerContext *, const ::sw::api::build::Plan *,
+        grpc::ServerWriter<::sw::api::build::PlanCommandResult> *) override;
 };
 
+/// registered worker
 struct SW_BUILDER_DISTRIBUTED_API Worker
-{
-
-};
+{
+    String id;
+    ::sw::api::build::WorkerInfo info;
+    std::unique_ptr<::sw::api::build::WorkerService::Stub> stub;
+    std::unique_ptr<::sw::api::build::BlobService::Stub> blobs;
+    std::atomic_int active{ 0 };
+    std::atomic_int failures{ 0 };
 
-struct SW_BUILDER_DISTRIBUTED_API Server
-{
-    std::unique_ptr<grpc::Server> server;
-    DistributedBuildServiceImpl dbs;
-    std::vector<std::unique_ptr<Session>> sessions;
-    std::vector<std::unique_ptr<Worker>> workers;
+    bool isCompatible(const ::sw::api::build::Command &) const;
+    double getLoad() const { return (double)active / info.capacity(); }
+};
 
-    Server();
+struct SW_BUILDER_DISTRIBUTED_API Server
+{
+    /// empty root - temp dir
+    Server(const path &storage_root = {});
     ~Server();
 
-    void start(const String &endpoint/*, const String &cert = {}*/);
+    /// returns bound port
+    int start(const String &endpoint/*, const String &cert = {}*/);
     void wait();
     void stop();
+    /// channel without network, server must be started
+    std::shared_ptr<grpc::Channel> getInProcessChannel() const;
+
+    String registerWorker(const ::sw::api::build::WorkerInfo &);
+    void unregisterWorker(const String &id);
+    size_t getNumberOfWorkers() const;
+    /// sum of capacities of workers, number of hardware threads when there are no workers
+    int getCapacity() const;
+
+    /// on workers if possible, locally otherwise
+    void executeCommand(const ::sw::api::build::Command &, ::sw::api::build::CommandResult &);
+    /// blocks until the plan is completed or cancelled
+    void executePlan(const ::sw::api::build::Plan &, const PlanExecution::ResultHandler &);
+    /// false if there is no such running plan
+    bool cancelPlan(const String &id);
+
+private:
+    BlobStore store;
+    DistributedBuildServiceImpl dbs;
+    BlobServiceImpl bs;
+    std::unique_ptr<grpc::Server> server;
+    std::vector<std::shared_ptr<Worker>> workers;
+    std::unordered_map<String, PlanExecution *> plans;
+    mutable std::mutex m;
+    int64_t next_worker_id = 0;
+
+    /// least loaded compatible worker
+    std::shared_ptr<Worker> selectWorker(const ::sw::api::build::Command &) const;
 };
 
 }
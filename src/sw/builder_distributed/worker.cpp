@@ -0,0 +1,302 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "worker.h"
+
+#include <sw/builder/os.h>
+
+#include <boost/algorithm/string.hpp>
+#include <grpcpp/grpcpp.h>
+#include <primitives/command.h>
+#include <primitives/exceptions.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "builder.distributed.worker");
+
+namespace sw::builder::distributed
+{
+
+namespace
+{
+
+// files of the sender are recreated under the root with their absolute paths,
+// so nothing outside of it is ever written;
+// toolchain and system files are not sent and are used from their real places
+struct Sandbox
+{
+    path root;
+    // sender dir -> sandbox dir, longest first
+    // whole sender roots are here, so include dirs with subdirs are remapped too
+    std::vector<std::pair<String, String>> dirs;
+
+    Sandbox(const path &root)
+        : root(root)
+    {
+        error_code ec;
+        fs::remove_all(root, ec); // leftovers of a crashed run
+        fs::create_directories(root);
+    }
+
+    ~Sandbox()
+    {
+        error_code ec;
+        fs::remove_all(root, ec);
+    }
+
+    path map(const path &p) const
+    {
+        if (p.empty() || !p.is_absolute())
+            return p;
+        auto rn = to_string(p.root_name());
+        rn.erase(std::remove(rn.begin(), rn.end(), ':'), rn.end());
+        return root / rn / p.relative_path();
+    }
+
+    void addDir(const path &d)
+    {
+        // never remap the whole filesystem
+        if (d.empty() || !d.is_absolute() || d.relative_path().empty())
+            return;
+        dirs.emplace_back(to_string(normalize_path(d)), to_string(normalize_path(map(d))));
+    }
+
+    void finishDirs()
+    {
+        std::sort(dirs.begin(), dirs.end(), [](auto &a, auto &b) { return a.first.size() > b.first.size(); });
+        dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+        for (auto &[_, d] : dirs)
+            fs::create_directories(d);
+    }
+
+    String mapText(const String &s) const { return replace(s, false); }
+    String unmapText(const String &s) const { return replace(s, true); }
+
+private:
+    // dir must not match a longer name: /a/b is not a prefix of /a/bc
+    static bool isPathEnd(const String &s, size_t i)
+    {
+        if (i == s.size())
+            return true;
+        switch (s[i])
+        {
+        case '/':
+        case '\\':
+        case '"':
+        case '\'':
+        case ':':
+        case ';':
+        case ',':
+        case ')':
+            return true;
+        }
+        return isspace((unsigned char)s[i]);
+    }
+
+    // single pass, so replaced parts are not replaced again
+    String replace(const String &s, bool back) const
+    {
+        String r;
+        r.reserve(s.size());
+        for (size_t i = 0; i < s.size();)
+        {
+            bool replaced = false;
+            for (auto &[from, to] : dirs)
+            {
+                auto &a = back ? to : from;
+                auto &b = back ? from : to;
+                if (s.compare(i, a.size(), a) == 0 && isPathEnd(s, i + a.size()))
+                {
+                    r += b;
+                    i += a.size();
+                    replaced = true;
+                    break;
+                }
+            }
+            if (!replaced)
+                r += s[i++];
+        }
+        return r;
+    }
+};
+
+}
+
+void executeCommand(BlobStore &store, const ::sw::api::build::Command &request, ::sw::api::build::CommandResult &response)
+{
+    static std::atomic<uint64_t> sandbox_id;
+    Sandbox sb(store.getRoot() / "sandbox" / std::to_string(sandbox_id++));
+
+    for (auto &r : request.roots())
+        sb.addDir(fs::u8path(r));
+    for (auto &f : request.inputs())
+        sb.addDir(fs::u8path(f.path()).parent_path());
+    for (auto &o : request.outputs())
+        sb.addDir(fs::u8path(o).parent_path());
+    for (auto &f : { request.in().file(), request.out().file(), request.err().file() })
+        sb.addDir(fs::u8path(f).parent_path());
+    sb.addDir(fs::u8path(request.working_directory()));
+    sb.finishDirs();
+
+    if (request.arguments().empty())
+        throw SW_RUNTIME_ERROR("Empty command");
+
+    for (auto &f : request.inputs())
+        store.materialize(f, sb.map(fs::u8path(f.path())));
+
+    primitives::Command c;
+    for (auto &a : request.arguments())
+    {
+        auto ma = sb.mapText(a);
+        c.push_back(ma);
+        // response files have paths too
+        if (ma.size() < 2 || ma[0] != '@' || ma == a)
+            continue;
+        auto rsp = fs::u8path(boost::trim_copy_if(ma.substr(1), boost::is_any_of("\"")));
+        if (fs::exists(rsp))
+            write_file(rsp, sb.mapText(read_file(rsp)));
+    }
+    // program built by the sender
+    if (auto prog = sb.mapText(request.arguments(0)); prog != request.arguments(0) && fs::exists(fs::u8path(prog)))
+        fs::permissions(fs::u8path(prog), fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec, fs::perm_options::add);
+    c.working_directory = sb.map(fs::u8path(request.working_directory()));
+    for (auto &[k, v] : request.environment())
+        c.environment[k] = v;
+    c.in.file = sb.map(fs::u8path(request.in().file()));
+    c.in.text = request.in().text();
+    c.out.file = sb.map(fs::u8path(request.out().file()));
+    c.err.file = sb.map(fs::u8path(request.err().file()));
+
+    // sender path -> sandbox path
+    std::map<path, path> outputs;
+    for (auto &o : request.outputs())
+        outputs[fs::u8path(o)] = sb.map(fs::u8path(o));
+    if (!c.out.file.empty())
+        outputs[fs::u8path(request.out().file())] = c.out.file;
+    if (!c.err.file.empty())
+        outputs[fs::u8path(request.err().file())] = c.err.file;
+    for (auto &[_, o] : outputs)
+        fs::create_directories(o.parent_path());
+
+    error_code ec;
+    c.execute(ec);
+    response.set_exit_code(c.exit_code ? *c.exit_code : -1);
+    // diagnostics and /showIncludes output must have sender paths
+    response.set_out(sb.unmapText(c.out.text));
+    response.set_err(c.exit_code ? sb.unmapText(c.err.text) : ec.message());
+    if (ec)
+        return;
+    if (!request.deps_file().empty())
+    {
+        auto d = sb.map(fs::u8path(request.deps_file()));
+        if (fs::exists(d))
+            write_file(d, sb.unmapText(read_file(d)));
+    }
+    for (auto &[o, so] : outputs)
+    {
+        if (!fs::exists(so))
+            continue;
+        // not addFile(), sandbox paths must not be cached
+        auto r = response.add_outputs();
+        r->set_path(to_string(normalize_path(o)));
+        r->set_hash(store.put(read_file(so)));
+    }
+}
+
+DEFINE_SERVICE_METHOD(WorkerService, ExecuteCommand, ::sw::api::build::Command, ::sw::api::build::CommandResult)
+{
+    pool.lock();
+    SCOPE_EXIT
+    {
+        pool.unlock();
+    };
+    try
+    {
+        executeCommand(store, *request, *response);
+    }
+    catch (std::exception &e)
+    {
+        return grpc::Status(grpc::StatusCode::INTERNAL, e.what());
+    }
+    GRPC_RETURN_OK();
+}
+
+WorkerServer::WorkerServer(const path &storage_root, int capacity)
+    : capacity(capacity < 1 ? (int)std::max(1u, std::thread::hardware_concurrency()) : capacity)
+    , store(storage_root)
+    , ws(store, this->capacity)
+    , bs(store)
+{
+}
+
+WorkerServer::~WorkerServer()
+{
+    if (server)
+        stop();
+}
+
+int WorkerServer::start(const String &endpoint)
+{
+    int port = 0;
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort(endpoint, grpc::InsecureServerCredentials(), &port);
+    builder.SetMaxReceiveMessageSize(-1);
+    builder.RegisterService(&ws);
+    builder.RegisterService(&bs);
+    server = builder.BuildAndStart();
+    if (!server)
+        throw SW_RUNTIME_ERROR("Cannot start worker on " + endpoint);
+    LOG_DEBUG(logger, "Worker is listening on port " << port << ", capacity " << capacity);
+    return port;
+}
+
+void WorkerServer::registerOn(const String &server_endpoint, const String &endpoint)
+{
+    coordinator = ::sw::api::build::DistributedBuildService::NewStub(
+        grpc::CreateChannel(server_endpoint, grpc::InsecureChannelCredentials()));
+
+    ::sw::api::build::WorkerInfo request;
+    request.set_endpoint(endpoint);
+    request.set_capacity(capacity);
+    request.set_os(toString(getHostOS().Type));
+    request.set_arch(toString(getHostOS().Arch));
+    auto context = std::make_unique<grpc::ClientContext>();
+    GRPC_SET_DEADLINE(10);
+    auto stub_ptr = coordinator.get();
+    GRPC_CALL_THROWS(stub_ptr, RegisterWorker, ::sw::api::build::WorkerId);
+    id = response.id();
+    LOG_INFO(logger, "Registered as worker " << id << " on " << server_endpoint);
+}
+
+void WorkerServer::wait()
+{
+    if (!server)
+        throw SW_RUNTIME_ERROR("Worker not started");
+    server->Wait();
+}
+
+void WorkerServer::stop()
+{
+    if (!server)
+        throw SW_RUNTIME_ERROR("Worker not started");
+    if (coordinator && !id.empty())
+    {
+        // server may be gone already
+        ::sw::api::build::WorkerId request;
+        request.set_id(id);
+        ::google::protobuf::Empty response;
+        grpc::ClientContext context;
+        context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(5));
+        auto s = coordinator->UnregisterWorker(&context, request, &response);
+        if (!s.ok())
+            LOG_DEBUG(logger, "Cannot unregister worker " << id << ": " << s.error_message());
+        id.clear();
+    }
+    server->Shutdown();
+}
+
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include "blob_store.h"
+
+#include <sw/builder/command.h>
+
+#include <grpcpp/server.h>
+
+#include <memory>
+
+namespace sw::builder::distributed
+{
+
+/// materialize inputs, run the command and store its outputs
+SW_BUILDER_DISTRIBUTED_API
+void executeCommand(BlobStore &, const ::sw::api::build::Command &, ::sw::api::build::CommandResult &);
+
+class WorkerServiceImpl : public ::sw::api::build::WorkerService::Service
+{
+public:
+    WorkerServiceImpl(BlobStore &store, int capacity) : store(store), pool(capacity) {}
+
+private:
+    BlobStore &store;
+    ResourcePool pool;
+
+    DECLARE_SERVICE_METHOD(ExecuteCommand, ::sw::api::build::Command, ::sw::api::build::CommandResult);
+};
+
+/// executes commands sent by the server
+struct SW_BUILDER_DISTRIBUTED_API WorkerServer
+{
+    /// capacity < 1 - number of hardware threads
+    WorkerServer(const path &storage_root, int capacity = 0);
+    ~WorkerServer();
+
+    /// returns bound port, use port 0 to select any free one
+    int start(const String &endpoint);
+    /// endpoint - where the server reaches this worker
+    void registerOn(const String &server_endpoint, const String &endpoint);
+    void wait();
+    void stop();
+
+    int getCapacity() const { return capacity; }
+
+private:
+    int capacity;
+    BlobStore store;
+    WorkerServiceImpl ws;
+    BlobServiceImpl bs;
+    std::unique_ptr<grpc::Server> server;
+    std::unique_ptr<::sw::api::build::DistributedBuildService::Stub> coordinator;
+    String id;
+};
+
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "../commands.h"
+
+#include <boost/algorithm/string.hpp>
+#include <nlohmann/json.hpp>
+
+#include <fstream>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "command.affected");
+
+SUBCOMMAND_DECL(affected)
+{
+    auto &opts = getOptions().options_affected;
+
+    Files changed;
+    for (auto &f : opts.affected_changed)
+        changed.insert(fs::absolute(f));
+    if (!opts.affected_changed_from.empty())
+    {
+        std::ifstream ifile(opts.affected_changed_from);
+        if (!ifile)
+            throw SW_RUNTIME_ERROR("Cannot open file: " + to_string(opts.affected_changed_from));
+        String line;
+        while (std::getline(ifile, line))
+        {
+            boost::trim(line);
+            if (!line.empty())
+                changed.insert(fs::absolute(line));
+        }
+    }
+    if (changed.empty())
+        throw SW_RUNTIME_ERROR("No changed files were specified");
+
+    auto b = createBuildAndPrepare(getInputs());
+    auto targets = b->getAffectedTargets(changed);
+    auto tests = b->getAffectedTests(targets);
+
+    // same package in several configs is reported once
+    std::set<String> tnames;
+    for (auto t : targets)
+        tnames.insert(t->getPackage().toString());
+    std::set<String> test_names;
+    for (const auto &[pkg, tgts] : b->getTargetsToBuild())
+    {
+        for (auto &tgt : tgts)
+        {
+            for (auto &c : tgt->getTests())
+            {
+                if (tests.contains(c))
+                    test_names.insert("[" + tgt->getPackage().toString() + "]/" + c->getName());
+            }
+        }
+    }
+
+    for (auto &t : tnames)
+        LOG_INFO(logger, "target: " << t);
+    for (auto &t : test_names)
+        LOG_INFO(logger, "test: " << t);
+
+    if (opts.affected_output.empty())
+        return;
+    nlohmann::json j;
+    j["targets"] = tnames;
+    j["tests"] = test_names;
+    write_file(opts.affected_output, j.dump(2));
+}
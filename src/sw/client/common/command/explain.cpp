@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "../commands.h"
+
+#include <sw/builder/file.h>
+#include <sw/support/filesystem.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_set>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "command.explain");
+
+template <class T>
+static auto sorted_by_count(const std::unordered_map<T, size_t> &m)
+{
+    std::vector<std::pair<T, size_t>> v(m.begin(), m.end());
+    std::sort(v.begin(), v.end(), [](const auto &a, const auto &b)
+    {
+        if (a.second != b.second)
+            return a.second > b.second;
+        return a.first < b.first;
+    });
+    return v;
+}
+
+SUBCOMMAND_DECL(explain)
+{
+    auto &opts = getOptions().options_explain;
+    auto fn = opts.explain_log.empty() ? sw::getExplainLogFile(fs::current_path() / SW_BINARY_DIR) : path(opts.explain_log);
+    if (!fs::exists(fn))
+        throw SW_RUNTIME_ERROR("No explain log: " + to_string(fn) + ". Run build with --explain-outdated first.");
+
+    std::ifstream ifile(fn);
+    std::unordered_map<String, size_t> reasons;
+    std::unordered_map<String, size_t> paths;
+    std::unordered_set<size_t> commands;
+    size_t n = 0;
+    String line;
+    while (std::getline(ifile, line))
+    {
+        if (line.empty())
+            continue;
+        auto j = nlohmann::json::parse(line, nullptr, false);
+        if (j.is_discarded())
+        {
+            LOG_WARN(logger, "Bad explain record: " << line);
+            continue;
+        }
+        String r = j["reason"];
+        if (!opts.explain_reason.empty() && r != opts.explain_reason)
+            continue;
+        n++;
+        reasons[r]++;
+        // first reason found is enough for every command
+        if (commands.insert(j["hash"].get<size_t>()).second && opts.explain_commands)
+            LOG_INFO(logger, r << ": " << j["name"].get<String>());
+        if (j.contains("path"))
+            paths[j["path"].get<String>()]++;
+    }
+
+    LOG_INFO(logger, "Outdated commands: " << commands.size() << " (" << n << " records)");
+    if (reasons.empty())
+        return;
+    LOG_INFO(logger, "Reasons:");
+    for (auto &[r, c] : sorted_by_count(reasons))
+        LOG_INFO(logger, "    " << r << ": " << c);
+    if (paths.empty())
+        return;
+    LOG_INFO(logger, "Top paths:");
+    int i = 0;
+    for (auto &[p, c] : sorted_by_count(paths))
+    {
+        if (opts.explain_top > 0 && i++ == opts.explain_top)
+            break;
+        LOG_INFO(logger, "    " << c << " " << p);
+    }
+}
@@ -4,6 +4,8 @@
 #include "../commands.h"
 
 #include <sw/builder_distributed/server.h>
+#include <sw/builder_distributed/worker.h>
+#include <sw/support/filesystem.h>
 
 SUBCOMMAND_DECL(server)
 {
@@ -17,5 +19,17 @@ SUBCOMMAND_DECL(server)
         return;
     }
 
+    if (getOptions().options_server.distributed_worker)
+    {
+        auto &o = getOptions().options_server;
+        if (o.coordinator.empty())
+            throw SW_RUNTIME_ERROR("Specify distributed build server with --coordinator");
+        sw::builder::distributed::WorkerServer w(sw::support::temp_directory_path() / "distributed" / "worker", o.capacity);
+        w.start(o.endpoint);
+        w.registerOn(o.coordinator, o.worker_endpoint.empty() ? o.endpoint : o.worker_endpoint);
+        w.wait();
+        return;
+    }
+
     SW_UNIMPLEMENTED;
 }
@@ -21,12 +21,14 @@ self-upgrade - upgrade the client. implement via upgrade?
 */
 
 SUBCOMMAND(abi) COMMA // rename? move to --option?
+SUBCOMMAND(affected) COMMA // targets and tests affected by changed files
 SUBCOMMAND(alias) COMMA
 SUBCOMMAND(build) COMMA
 //SUBCOMMAND(b) COMMA // alias for build
 SUBCOMMAND(configure) COMMA
 SUBCOMMAND(create) COMMA
 SUBCOMMAND(doc) COMMA // invokes documentation (hopefully)
+SUBCOMMAND(explain) COMMA // summary of the last explain-outdated log
 SUBCOMMAND(generate) COMMA
 // rename to query?
 SUBCOMMAND(get) COMMA // returns different information
@@ -0,0 +1,421 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "daemon.h"
+
+#include <sw/support/filesystem.h>
+
+#include <boost/dll.hpp>
+#include <primitives/exceptions.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "daemon");
+
+// bump on any change of the request format
+static const uint32_t daemon_protocol_version = 2;
+
+path getDaemonSocket()
+{
+    // relative path keeps us inside sun_path limits
+    return path(SW_BINARY_DIR) / "daemon.sock";
+}
+
+#ifdef _WIN32
+
+void serveDaemon(const std::function<int(const Strings &)> &)
+{
+    throw SW_RUNTIME_ERROR("Build daemon is not supported on this platform");
+}
+
+std::optional<int> runInDaemon(const Strings &)
+{
+    return {};
+}
+
+void stopDaemon()
+{
+    throw SW_RUNTIME_ERROR("Build daemon is not supported on this platform");
+}
+
+#else
+
+namespace
+{
+
+struct Request
+{
+    Strings args;
+    path cwd;
+    String binary;
+    int fds[3] = { -1, -1, -1 };
+};
+
+// client stdio is used while the request is running
+struct StdioRedirect
+{
+    int saved[3];
+
+    StdioRedirect(const int (&fds)[3])
+    {
+        flush();
+        for (int i = 0; i < 3; i++)
+        {
+            saved[i] = dup(i);
+            dup2(fds[i], i);
+            close(fds[i]);
+        }
+    }
+
+    ~StdioRedirect()
+    {
+        flush();
+        for (int i = 0; i < 3; i++)
+        {
+            dup2(saved[i], i);
+            close(saved[i]);
+        }
+    }
+
+private:
+    static void flush()
+    {
+        LOG_FLUSH();
+        std::cout.flush();
+        std::cerr.flush();
+        fflush(stdout);
+        fflush(stderr);
+    }
+};
+
+}
+
+static sockaddr_un getAddress()
+{
+    sockaddr_un a{};
+    a.sun_family = AF_UNIX;
+    auto s = to_string(getDaemonSocket());
+    if (s.size() >= sizeof(a.sun_path))
+        throw SW_RUNTIME_ERROR("Daemon socket path is too long: " + s);
+    strcpy(a.sun_path, s.c_str());
+    return a;
+}
+
+static void write_all(int fd, const void *p, size_t sz)
+{
+    auto b = (const char *)p;
+    while (sz)
+    {
+        auto r = ::write(fd, b, sz);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            throw SW_RUNTIME_ERROR("Cannot write to daemon socket");
+        b += r;
+        sz -= r;
+    }
+}
+
+static void read_all(int fd, void *p, size_t sz)
+{
+    auto b = (char *)p;
+    while (sz)
+    {
+        auto r = ::read(fd, b, sz);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            throw SW_RUNTIME_ERROR("Cannot read from daemon socket");
+        b += r;
+        sz -= r;
+    }
+}
+
+static void write_string(int fd, const String &s)
+{
+    uint32_t sz = s.size();
+    write_all(fd, &sz, sizeof(sz));
+    write_all(fd, s.data(), sz);
+}
+
+static String read_string(int fd)
+{
+    uint32_t sz;
+    read_all(fd, &sz, sizeof(sz));
+    String s(sz, 0);
+    read_all(fd, s.data(), sz);
+    return s;
+}
+
+// daemon started by another sw binary must not serve our builds
+static String getBinaryId()
+{
+    path p(boost::dll::program_location().wstring());
+    return to_string(p)
+        + " " + std::to_string(fs::file_size(p))
+        + " " + std::to_string(fs::last_write_time(p).time_since_epoch().count());
+}
+
+// both sides talk only to processes of the same user
+static bool isSameUser(int fd)
+{
+#ifdef __linux__
+    ucred cr{};
+    socklen_t sz = sizeof(cr);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cr, &sz) == -1)
+        return false;
+    return cr.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) == -1)
+        return false;
+    return uid == getuid();
+#endif
+}
+
+static void closeFds(const int (&fds)[3])
+{
+    for (auto f : fds)
+    {
+        if (f != -1)
+            close(f);
+    }
+}
+
+static int connectDaemon()
+{
+    auto a = getAddress();
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+    if (connect(fd, (sockaddr *)&a, sizeof(a)) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// header goes together with stdio descriptors
+static void sendRequest(int fd, const Strings &args)
+{
+    uint32_t hdr[2] = { daemon_protocol_version, (uint32_t)args.size() };
+    iovec iov{ hdr, sizeof(hdr) };
+    int fds[3] = { 0, 1, 2 };
+    char cbuf[CMSG_SPACE(sizeof(fds))]{};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, 0) != sizeof(hdr))
+        throw SW_RUNTIME_ERROR("Cannot send request to daemon");
+
+    for (auto &a : args)
+        write_string(fd, a);
+    write_string(fd, to_string(fs::current_path()));
+    write_string(fd, getBinaryId());
+}
+
+static Request receiveRequest(int fd)
+{
+    Request r;
+    uint32_t hdr[2];
+    iovec iov{ hdr, sizeof(hdr) };
+    char cbuf[CMSG_SPACE(sizeof(r.fds))]{};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    if (recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != sizeof(hdr))
+        throw SW_RUNTIME_ERROR("Bad daemon request");
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(r.fds)))
+        memcpy(r.fds, CMSG_DATA(cmsg), sizeof(r.fds));
+    SCOPE_EXIT
+    {
+        // only for error paths, descriptors are taken by the redirect
+        if (std::uncaught_exceptions())
+            closeFds(r.fds);
+    };
+    if (hdr[0] != daemon_protocol_version)
+        throw SW_RUNTIME_ERROR("Daemon protocol mismatch: " + std::to_string(hdr[0]) + " != " + std::to_string(daemon_protocol_version));
+    if (hdr[1] && std::find(std::begin(r.fds), std::end(r.fds), -1) != std::end(r.fds))
+        throw SW_RUNTIME_ERROR("No stdio descriptors in daemon request");
+    for (uint32_t i = 0; i < hdr[1]; i++)
+        r.args.push_back(read_string(fd));
+    r.cwd = read_string(fd);
+    r.binary = read_string(fd);
+    return r;
+}
+
+void serveDaemon(const std::function<int(const Strings &)> &handler)
+{
+    auto fd = connectDaemon();
+    if (fd != -1)
+    {
+        close(fd);
+        throw SW_RUNTIME_ERROR("Daemon is already running: " + to_string(getDaemonSocket()));
+    }
+
+    auto sp = getDaemonSocket();
+    fs::create_directories(sp.parent_path());
+    error_code ec;
+    fs::remove(sp, ec); // stale
+
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s == -1)
+        throw SW_RUNTIME_ERROR("Cannot create daemon socket");
+    SCOPE_EXIT
+    {
+        close(s);
+        error_code ec;
+        fs::remove(getDaemonSocket(), ec);
+    };
+    auto a = getAddress();
+    if (bind(s, (sockaddr *)&a, sizeof(a)) == -1 || chmod(a.sun_path, S_IRUSR | S_IWUSR) == -1 || listen(s, 16) == -1)
+        throw SW_RUNTIME_ERROR("Cannot listen on daemon socket: " + to_string(sp));
+
+    const auto binary = getBinaryId();
+    auto root = fs::current_path();
+    LOG_INFO(logger, "Build daemon is listening on " << to_string(normalize_path(root / sp)));
+    while (1)
+    {
+        int c = accept4(s, nullptr, nullptr, SOCK_CLOEXEC);
+        if (c == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            throw SW_RUNTIME_ERROR("Cannot accept daemon connection");
+        }
+        SCOPE_EXIT
+        {
+            close(c);
+        };
+        if (!isSameUser(c))
+        {
+            LOG_WARN(logger, "Daemon connection from another user is rejected");
+            continue;
+        }
+
+        try
+        {
+            auto r = receiveRequest(c);
+            // stop request is accepted from any sw binary
+            int32_t accepted = r.args.empty() || r.binary == binary;
+            if (!accepted)
+                closeFds(r.fds);
+            write_all(c, &accepted, sizeof(accepted));
+            if (!accepted)
+            {
+                LOG_INFO(logger, "Request from another sw binary is rejected: " << r.binary);
+                continue;
+            }
+
+            if (r.args.empty())
+            {
+                closeFds(r.fds);
+                int32_t code = 0;
+                write_all(c, &code, sizeof(code));
+                LOG_INFO(logger, "Build daemon is stopped");
+                break;
+            }
+
+            int32_t code = 1;
+            {
+                StdioRedirect redirect(r.fds);
+                try
+                {
+                    fs::current_path(r.cwd);
+                    code = handler(r.args);
+                }
+                catch (std::exception &e)
+                {
+                    LOG_ERROR(logger, e.what());
+                }
+                // request may change it (-d)
+                fs::current_path(root);
+            }
+            write_all(c, &code, sizeof(code));
+        }
+        catch (std::exception &e)
+        {
+            LOG_ERROR(logger, "Daemon request failed: " << e.what());
+        }
+    }
+}
+
+std::optional<int> runInDaemon(const Strings &args)
+{
+    if (args.empty())
+        throw SW_LOGIC_ERROR("Empty daemon request");
+    if (!fs::exists(getDaemonSocket()))
+        return {};
+    auto fd = connectDaemon();
+    if (fd == -1)
+        return {};
+    SCOPE_EXIT
+    {
+        close(fd);
+    };
+    if (!isSameUser(fd))
+    {
+        LOG_WARN(logger, "Daemon is run by another user, building locally");
+        return {};
+    }
+    sendRequest(fd, args);
+    // nothing is run before acceptance, so it is safe to build locally
+    int32_t accepted = 0;
+    try
+    {
+        read_all(fd, &accepted, sizeof(accepted));
+    }
+    catch (std::exception &)
+    {
+    }
+    if (!accepted)
+    {
+        LOG_WARN(logger, "Daemon is run by another sw binary, building locally. Restart the daemon to use it again");
+        return {};
+    }
+    LOG_DEBUG(logger, "Running in daemon");
+    int32_t code;
+    read_all(fd, &code, sizeof(code));
+    return code;
+}
+
+void stopDaemon()
+{
+    auto fd = connectDaemon();
+    if (fd == -1)
+        throw SW_RUNTIME_ERROR("Daemon is not running");
+    SCOPE_EXIT
+    {
+        close(fd);
+    };
+    if (!isSameUser(fd))
+        throw SW_RUNTIME_ERROR("Daemon is run by another user");
+    sendRequest(fd, {});
+    int32_t accepted, code;
+    read_all(fd, &accepted, sizeof(accepted));
+    read_all(fd, &code, sizeof(code));
+}
+
+#endif
@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <functional>
+#include <optional>
+
+// resident build daemon
+// one daemon serves one directory, requests are executed one by one
+
+/// socket of the daemon for the current directory
+path getDaemonSocket();
+
+/// handler receives client arguments and returns exit code
+/// client stdio is redirected to the daemon process during the call
+void serveDaemon(const std::function<int(const Strings &)> &handler);
+
+/// returns exit code if the daemon was reached
+std::optional<int> runInDaemon(const Strings &args);
+
+void stopDaemon();
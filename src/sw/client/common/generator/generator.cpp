@@ -10,12 +10,17 @@
 #include <sw/core/sw_context.h>
 #include <sw/manager/storage.h>
 #include <sw/support/filesystem.h>
+#include <sw/support/hash.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/dll.hpp>
 #include <nlohmann/json.hpp>
+#include <primitives/hash.h>
 #include <primitives/sw/cl.h>
 #include <primitives/pack.h>
 
+#include <fstream>
+
 #include <primitives/log.h>
 DECLARE_STATIC_LOGGER(logger, "generator");
 
@@ -367,7 +372,7 @@ private:
 
 struct NinjaEmitter : primitives::Emitter
 {
-    NinjaEmitter(const SwBuild &b, const path &dir)
+    NinjaEmitter(const SwBuild &b, const path &dir, bool regenerate)
         : dir(dir)
     {
         addLine("include " + commands_fn);
@@ -376,6 +381,12 @@ struct NinjaEmitter : primitives::Emitter
         auto explan = b.getExecutionPlan();
         auto &ep = *explan;
 
+        // pools must be declared before use
+        for (auto &c : ep.getCommands())
+            addPool(static_cast<builder::Command*>(c)->pool.get());
+        if (regenerate)
+            addRegenerateRule(b);
+
         for (auto &c : ep.getCommands())
             addCommand(b, *static_cast<builder::Command*>(c));
 
@@ -398,6 +409,7 @@ struct NinjaEmitter : primitives::Emitter
 private:
     path dir;
     ProgramShortCutter sc;
+    std::unordered_map<const ResourcePool *, String> pools;
     static inline const String commands_fn = "commands.ninja";
 
     path getRspDir() const
@@ -432,6 +444,85 @@ private:
         return s2;
     }
 
+    void addPool(const ResourcePool *p)
+    {
+        if (!p || p->getLimit() < 1 || pools.contains(p))
+            return;
+        auto name = "sw_pool_" + (p->name.empty() ? std::to_string(pools.size()) : p->name);
+        pools[p] = name;
+        addLine("pool " + name);
+        increaseIndent();
+        addLine("depth = " + std::to_string(p->getLimit()));
+        decreaseIndent();
+        addLine();
+    }
+
+    // build.ninja is regenerated by ninja itself when sw inputs change
+    void addRegenerateRule(const SwBuild &b)
+    {
+        auto quote = [](String s)
+        {
+            boost::replace_all(s, "\\", "\\\\");
+            boost::replace_all(s, "\"", "\\\"");
+            return "\"" + s + "\"";
+        };
+
+        Files files;
+        String args = "generate -G ninja -input-settings-pairs ";
+        for (auto &i : b.getInputs())
+        {
+            for (auto &[_, f] : i.getInput().getInput().getSpecification().files.getData())
+            {
+                files.insert(f.absolute_path);
+                for (auto &s : i.getSettings())
+                    args += quote(to_string(normalize_path(f.absolute_path))) + " " + quote(s.toString()) + " ";
+            }
+        }
+        if (files.empty())
+            return;
+        for (auto &[_, tgts] : b.getTargetsToBuild())
+        {
+            for (auto &t : tgts)
+            {
+                for (auto &cf : t->getInterfaceSettings()["ide"]["configure_files"].getArray())
+                    files.insert(cf.getPathValue(b.getContext().getLocalStorage()));
+            }
+        }
+
+        auto prog = to_string(normalize_path(path(boost::dll::program_location().wstring())));
+        String cmd = "cd ";
+        if (b.getContext().getHostOs().Type == OSType::Windows)
+            cmd += "/D ";
+        cmd += quote(getShortName(fs::current_path())) + " && " + quote(prog) + " " + args;
+        if (b.getContext().getHostOs().Type == OSType::Windows)
+            cmd = "cmd /S /C \"" + cmd + "\"";
+        boost::replace_all(cmd, "$", "$$");
+
+        addLine("rule sw_regenerate");
+        increaseIndent();
+        addLine("command = " + cmd);
+        addLine("description = Regenerating build.ninja");
+        addLine("generator = 1");
+        addLine("restat = 1");
+        decreaseIndent();
+        addLine();
+
+        addLine("build build.ninja: sw_regenerate ");
+        for (auto &f : files)
+            addText(prepareString(b, getShortName(f)) + " ");
+        addLine();
+        emptyLines(1);
+    }
+
+    // outputs may be left untouched (written only if different)
+    static bool needsRestat(const builder::Command &c)
+    {
+        if (dynamic_cast<const builder::BuiltinCommand *>(&c))
+            return true;
+        // programs built by us (generators)
+        return File(c.getProgram(), c.getContext().getFileStorage()).isGenerated();
+    }
+
     void addCommand(const SwBuild &b, const builder::Command &c)
     {
         bool rsp = c.needsResponseFile();
@@ -448,8 +539,6 @@ private:
         addLine("rule c" + std::to_string(c.getHash()));
         increaseIndent();
         addLine("description = " + c.getName());
-        if (!c.msvc_prefix.empty())
-            addLine("msvc_deps_prefix = \"" + c.msvc_prefix + "\"");
         addLine("command = ");
         if (b.getContext().getHostOs().Type == OSType::Windows)
         {
@@ -512,10 +601,35 @@ private:
         //
         if (b.getContext().getHostOs().Type == OSType::Windows)
             addText("\"");
-        if (prog.find("cl.exe") != prog.npos)
+        switch (c.deps_processor)
+        {
+        case builder::Command::DepsProcessor::Gnu:
+            if (!c.deps_file.empty())
+            {
+                addLine("depfile = " + prepareString(b, getShortName(c.deps_file)));
+                addLine("deps = gcc");
+            }
+            break;
+        case builder::Command::DepsProcessor::Msvc:
             addLine("deps = msvc");
-        else if (has_mmd)
-            addLine("depfile = " + to_string((c.outputs.begin()->parent_path() / (c.outputs.begin()->stem().string() + ".d")).u8string()));
+            break;
+        default:
+            // guess for commands without deps processor
+            if (prog.find("cl.exe") != prog.npos)
+                addLine("deps = msvc");
+            else if (has_mmd)
+            {
+                addLine("depfile = " + to_string((c.outputs.begin()->parent_path() / (c.outputs.begin()->stem().string() + ".d")).u8string()));
+                addLine("deps = gcc");
+            }
+            break;
+        }
+        if (!c.msvc_prefix.empty())
+            addLine("msvc_deps_prefix = " + c.msvc_prefix); // no quotes, value is taken as is
+        if (needsRestat(c))
+            addLine("restat = 1");
+        if (auto i = pools.find(c.pool.get()); i != pools.end())
+            addLine("pool = " + i->second);
         if (rsp)
         {
             addLine("rspfile = " + to_string(rsp_file.u8string()));
@@ -544,11 +658,11 @@ private:
     }
 };
 
-static Files generate_ninja(const SwBuild &b, const path &root_dir)
+static Files generate_ninja(const SwBuild &b, const path &root_dir, bool regenerate = false)
 {
     // https://ninja-build.org/manual.html#_writing_your_own_ninja_files
 
-    NinjaEmitter ctx(b, root_dir);
+    NinjaEmitter ctx(b, root_dir, regenerate);
     write_file(root_dir / "build.ninja", ctx.getText());
 
     auto files = ctx.getCreatedFiles();
@@ -558,7 +672,7 @@ static Files generate_ninja(const SwBuild &b, const path &root_dir)
 
 void NinjaGenerator::generate(const SwBuild &b)
 {
-    generate_ninja(b, getRootDirectory(b));
+    generate_ninja(b, getRootDirectory(b), true);
 }
 
 static bool should_print(const String &o)
@@ -1168,15 +1282,41 @@ void CompilationDatabaseGenerator::generate(const SwBuild &b)
     checkForSingleSettingsInputs(b);
 
     const auto d = getRootDirectory(b);
+    const auto fragments_dir = d / "compdb";
+    const auto fn = d / "compile_commands.json";
 
     auto p = b.getExecutionPlan();
 
-    nlohmann::json j;
+    // per target fragments: first line is the hash of target commands, then entries
+    bool changed = !fs::exists(fn);
+    std::set<path> fragments; // ordered, output is stable
     for (auto &[p, tgts] : b.getTargetsToBuild())
     {
         for (auto &tgt : tgts)
         {
-            for (auto &c : tgt->getCommands())
+            auto cmds = tgt->getCommands();
+            size_t h = 0;
+            for (auto &c : cmds)
+            {
+                hash_combine(h, c->getHash());
+                for (auto &i : c->inputs)
+                    hash_combine(h, std::hash<path>()(i));
+            }
+            auto key = std::to_string(h);
+
+            auto ffn = fragments_dir / (shorten_hash(blake2b_512(tgt->getPackage().toString() + " " + tgt->getSettings().getHash()), 8) + ".json");
+            fragments.insert(ffn);
+            if (fs::exists(ffn))
+            {
+                std::ifstream ifile(ffn);
+                String line;
+                if (std::getline(ifile, line) && line == key)
+                    continue;
+            }
+            changed = true;
+
+            String entries;
+            for (auto &c : cmds)
             {
                 nlohmann::json j2;
                 if (!c->working_directory.empty())
@@ -1207,11 +1347,58 @@ void CompilationDatabaseGenerator::generate(const SwBuild &b)
                 }
                 for (auto &a : c->arguments)
                     j2["arguments"].push_back(a->toString());
-                j.push_back(j2);
+                auto s = j2.dump(2);
+                boost::replace_all(s, "\n", "\n  ");
+                entries += "  " + s + ",\n";
             }
+            write_file(ffn, key + "\n" + entries);
+        }
+    }
+
+    // stale fragments
+    if (fs::exists(fragments_dir))
+    {
+        for (auto &f : fs::directory_iterator(fragments_dir))
+        {
+            if (fragments.contains(f.path()))
+                continue;
+            fs::remove(f.path());
+            changed = true;
+        }
+    }
+    if (!changed)
+    {
+        LOG_DEBUG(logger, "Compilation database is up to date");
+        return;
+    }
+
+    // merge, replace atomically so readers never see partial file
+    auto tmp = path(fn) += ".tmp";
+    {
+        std::ofstream ofile(tmp, std::ios::binary);
+        if (!ofile)
+            throw SW_RUNTIME_ERROR("Cannot open file: " + to_string(tmp));
+        ofile << "[\n";
+        bool first = true;
+        for (auto &f : fragments)
+        {
+            std::ifstream ifile(f, std::ios::binary);
+            String line;
+            std::getline(ifile, line); // key
+            String entries{ std::istreambuf_iterator<char>(ifile), std::istreambuf_iterator<char>() };
+            if (entries.size() < 2)
+                continue;
+            entries.resize(entries.size() - 2); // last ",\n"
+            if (!first)
+                ofile << ",\n";
+            ofile << entries;
+            first = false;
         }
+        ofile << "\n]\n";
+        if (!ofile)
+            throw SW_RUNTIME_ERROR("Cannot write file: " + to_string(tmp));
     }
-    write_file(d / "compile_commands.json", j.dump(2));
+    fs::rename(tmp, fn);
 }
 
 void SwExecutionPlanGenerator::generate(const sw::SwBuild &b)
@@ -13,6 +13,7 @@
 #include <sw/core/input.h>
 #include <sw/core/specification.h>
 #include <sw/core/sw_context.h>
+#include <sw/core/target_graph.h>
 #include <sw/driver/build_settings.h>
 #include <sw/manager/storage.h>
 #include <sw/support/filesystem.h>
@@ -588,19 +589,25 @@ void VSGenerator::generate(const SwBuild &b)
             d.build_rules.erase(d.main_command);
         }
     }
+    const auto &g = b.getTargetGraph();
     for (auto &[pkg, tgts] : ttb)
     {
         for (auto &tgt : tgts)
         {
             auto &p = s.projects.find(tgt->getPackage().toString())->second;
             auto &data = p.getData(tgt->getSettings());
-            auto &is = tgt->getInterfaceSettings();
+            auto &n = g.getNode(g.getIndex(*tgt));
+            if (!n.unresolved_link.empty())
+                throw SW_LOGIC_ERROR("Cannot find dependency: " + n.unresolved_link[0]);
+            if (!n.unresolved_dummy.empty())
+                throw SW_LOGIC_ERROR("Cannot find dependency: " + n.unresolved_dummy[0]);
 
-            auto add_deps = [&ttb, &data, &s, &b, &p](auto &is)
+            auto add_deps = [&ttb, &data, &s, &b, &p, &g](const auto &deps)
             {
-                for (auto &[id, v] : is)
+                for (auto i : deps)
                 {
-                    PackageId d(id);
+                    const auto &t = *g.getNode(i).target;
+                    const auto &d = t.getPackage();
                     // filter out predefined targets
                     if (b.isPredefinedTarget(d))
                         continue;
@@ -610,18 +617,15 @@ void VSGenerator::generate(const SwBuild &b)
                     auto &pd = ttb;
                     if (pd.find(d) == pd.end())
                     {
-                        auto i = b.getTargets().find(d, v.getMap());
-                        if (!i)
-                            throw SW_LOGIC_ERROR("Cannot find dependency: " + d.toString());
-                        data.dependencies.insert(i);
+                        data.dependencies.insert(&t);
                         continue;
                     }
                     p.dependencies.insert(&s.projects.find(d.toString())->second);
                 }
             };
 
-            add_deps(is["dependencies"]["link"].getMap());
-            add_deps(is["dependencies"]["dummy"].getMap());
+            add_deps(n.link);
+            add_deps(n.dummy);
 
             //
             if (!s.first_project && n_executables == 1 && tgt->getInterfaceSettings()["type"] == "native_executable")
@@ -4,9 +4,12 @@
 #include "main.h"
 
 #include "commands.h"
+#include "daemon.h"
 #include "self_upgrade.h"
 
+#include <sw/builder/command.h>
 #include <sw/builder/jumppad.h>
+#include <sw/builder/time_trace.h>
 #include <sw/driver/driver.h>
 #include <sw/manager/settings.h>
 
@@ -154,6 +157,19 @@ int StartupData::run()
             return true;
         }
 
+        if (getClOptions().subcommand_server && getOptions().options_server.stop_daemon)
+        {
+            stopDaemon();
+            return exit(0);
+        }
+        if (getClOptions().subcommand_server && getOptions().options_server.daemon)
+            return exit(runDaemon());
+        if (!getOptions().no_daemon && (getClOptions().subcommand_build || getClOptions().subcommand_test))
+        {
+            if (auto r = runInDaemon(args))
+                return exit(*r);
+        }
+
         setup();
         if (after_setup && after_setup(*this))
             return exit(0);
@@ -382,6 +398,35 @@ void StartupData::sw_main()
     LOG_WARN(logger, "No command was issued");
 }
 
+int StartupData::runDaemon()
+{
+    SwClientContext::setResident(true);
+    SCOPE_EXIT
+    {
+        SwClientContext::setResident(false);
+    };
+    serveDaemon([this](const Strings &in_args)
+    {
+        args = in_args;
+        exit_code.reset();
+        options.reset();
+        cloptions.reset();
+        // process wide build state of the previous request
+        sw::TimeTrace::get().reset();
+        sw::resetResourcePools();
+
+        parseArgs();
+        createOptions();
+        // client has already changed the working dir
+        setup();
+        if (exit_code)
+            return *exit_code;
+        sw_main();
+        return 0;
+    });
+    return 0;
+}
+
 int StartupData::exit(int r)
 {
     exit_code = r;
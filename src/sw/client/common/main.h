@@ -49,6 +49,7 @@ struct SW_CLIENT_COMMON_API StartupData
 private:
     int exit(int);
     int builtinCall();
+    int runDaemon();
     void initLogger();
     void setWorkingDir();
     void setHttpSettings();
@@ -12,6 +12,7 @@
 #include <primitives/emitter.h>
 #include <primitives/executor.h>
 #include <primitives/http.h>
+#include <sw/builder_distributed/client.h>
 #include <sw/core/build.h>
 #include <sw/core/input.h>
 #include <sw/core/sw_context.h>
@@ -363,6 +364,25 @@ Inputs::Inputs(const Strings &s, const Strings &pairs)
     }
 }
 
+namespace
+{
+
+struct ResidentContext
+{
+    bool enabled = false;
+    // context is reused only with the same settings
+    String key;
+    std::unique_ptr<sw::SwContext> swctx;
+};
+
+ResidentContext &getResidentContext()
+{
+    static ResidentContext r;
+    return r;
+}
+
+}
+
 SwClientContext::SwClientContext(const Options &options)
     : local_storage_root_dir(options.storage_dir.empty() ? sw::Settings::get_user_settings().storage_dir : options.storage_dir)
     , options(std::make_unique<Options>(options))
@@ -375,6 +395,20 @@ SwClientContext::SwClientContext(const Options &options)
 
 SwClientContext::~SwClientContext()
 {
+    auto &r = getResidentContext();
+    if (r.enabled && swctx_)
+    {
+        r.key = resident_key;
+        r.swctx = std::move(swctx_);
+    }
+}
+
+void SwClientContext::setResident(bool b)
+{
+    auto &r = getResidentContext();
+    r.enabled = b;
+    if (!b)
+        r.swctx.reset();
 }
 
 std::unique_ptr<sw::SwBuild> SwClientContext::createBuild()
@@ -388,6 +422,14 @@ std::unique_ptr<sw::SwBuild> SwClientContext::createBuildInternal()
     auto &options = getOptions();
 
     b->setName(options.build_name);
+    if (!options.distributed_build.empty())
+    {
+        auto c = std::make_unique<sw::builder::distributed::Client>(options.distributed_build);
+        c->addRoot(fs::current_path());
+        c->addRoot(b->getBuildDirectory());
+        c->addRoot(getContext().getLocalStorage().storage_dir);
+        b->setRemoteExecutor(std::move(c));
+    }
 
     sw::TargetSettings bs;
 
@@ -431,6 +473,14 @@ std::unique_ptr<sw::SwBuild> SwClientContext::createBuildInternal()
 
     if (!options.options_build.time_limit.empty())
         bs["time_limit"] = options.options_build.time_limit;
+    if (!options.options_test.shard.empty())
+        bs["test-shard"] = options.options_test.shard;
+    if (!options.options_test.test_timeout.empty())
+        bs["test-timeout"] = options.options_test.test_timeout;
+    if (options.options_test.test_jobs > 0)
+        bs["test-jobs"] = std::to_string(options.options_test.test_jobs);
+    if (!options.options_test.rerun.empty())
+        bs["test-rerun"] = options.options_test.rerun;
     if (options.verbose || options.trace)
         bs["measure"] = "true";
     bs["verbose"] = (options.verbose || options.trace) ? "true" : "";
@@ -455,6 +505,8 @@ std::unique_ptr<sw::SwBuild> SwClientContext::createBuildInternal()
         bs["build-jobs"] = std::to_string(select_number_of_threads(options.build_jobs));
     if (options.prepare_jobs)
         bs["prepare-jobs"] = std::to_string(select_number_of_threads(options.prepare_jobs));
+    if (options.build_memory)
+        bs["build-memory"] = std::to_string(options.build_memory);
     for (auto &t : options.Dvariables)
     {
         auto p = t.find('=');
@@ -809,6 +861,16 @@ sw::SwContext &SwClientContext::getContext(bool in_allow_network)
         SET_BOOL_OPTION(do_not_remove_bad_module);
 #undef SET_BOOL_OPTION
 
+        auto &r = getResidentContext();
+        resident_key = to_string(normalize_path(local_storage_root_dir)) + " " + std::to_string(allow_network) + " " + cs.getHash();
+        if (r.swctx && r.key == resident_key)
+        {
+            LOG_DEBUG(logger, "Using resident context");
+            swctx_ = std::move(r.swctx);
+            return *swctx_;
+        }
+        r.swctx.reset();
+
         // create ctx
         swctx_ = std::make_unique<sw::SwContext>(local_storage_root_dir, allow_network);
         swctx_->setSettings(cs);
@@ -818,6 +880,8 @@ sw::SwContext &SwClientContext::getContext(bool in_allow_network)
         //swctx->registerDriver(std::make_unique<sw::driver::cpp::Driver>());
         swctx_->registerDriver("org.sw.sw.driver.cpp-0.4.1"s, std::make_unique<sw::driver::cpp::Driver>(*swctx_));
         //swctx->registerDriver(std::make_unique<sw::CDriver>(sw_create_driver));
+        if (r.enabled)
+            swctx_->setResident(true);
     }
     return *swctx_;
 }
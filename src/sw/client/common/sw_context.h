@@ -62,6 +62,9 @@ struct SW_CLIENT_COMMON_API SwClientContext
     sw::SwContext &getContext(bool allow_network = true);
     void resetContext();
 
+    /// keep context alive between client contexts (build daemon)
+    static void setResident(bool);
+
     Options &getOptions() { return *options; }
     const Options &getOptions() const { return *options; }
 
@@ -100,6 +103,7 @@ private:
     path local_storage_root_dir;
     std::unique_ptr<Executor> executor;
     std::unique_ptr<sw::SwContext> swctx_;
+    String resident_key;
     // we can copy options into unique ptr also
     std::unique_ptr<Options> options;
     std::optional<sw::TargetMap> tm;
@@ -5,11 +5,17 @@
 
 #include "driver.h"
 #include "input.h"
+#include "saved_configs.h"
 #include "sw_context.h"
+#include "target_graph.h"
 
+#include <sw/builder/command_storage.h>
 #include <sw/builder/execution_plan.h>
+#include <sw/builder/file.h>
 #include <sw/builder/jumppad.h>
+#include <sw/builder/time_trace.h>
 #include <sw/manager/storage.h>
+#include <sw/support/hash.h>
 
 #include <boost/current_function.hpp>
 #include <magic_enum.hpp>
@@ -83,10 +89,24 @@ static auto create_target(const path &sfn, const LocalPackage &pkg, const Target
     return tgt;
 }
 
-static std::shared_ptr<PredefinedTarget> create_target(const LocalPackage &p, const TargetSettings &s)
+static std::shared_ptr<PredefinedTarget> create_target(const LocalPackage &p, const TargetSettings &s, const SavedConfigs &sc)
 {
     auto cfg = s.getHash();
     auto base = p.getDirObj(cfg);
+
+    // snapshot record is valid while it has the same interface hash as the package dir
+    auto sptrfn = base / "settings.hash";
+    if (sc.size() && fs::exists(sptrfn))
+    {
+        if (auto its = sc.load(p.toString(), cfg, read_file(sptrfn)))
+        {
+            LOG_TRACE(logger, "loading " << p.toString() << ": " << cfg << " from saved configs snapshot");
+            auto tgt = std::make_shared<PredefinedTarget>(p, s);
+            tgt->public_ts = std::move(*its);
+            return tgt;
+        }
+    }
+
     auto sfn = base / get_settings_fn();
     if (fs::exists(sfn))
     {
@@ -189,7 +209,13 @@ static void saveLockFile(const path &fn, const std::unordered_map<UnresolvedPack
             //jp[u.toString()]["installed"] = true;
     }
 
-    write_file_if_different(fn, j.dump(2));
+    // atomic, so interrupted builds do not leave broken lock files
+    auto s = j.dump(2);
+    if (fs::exists(fn) && read_file(fn) == s)
+        return;
+    auto t = path(fn) += ".tmp";
+    write_file(t, s);
+    fs::rename(t, fn);
 }
 
 static ExecutionPlan::Clock::duration parseTimeLimit(String tl)
@@ -203,7 +229,7 @@ static ExecutionPlan::Clock::duration parseTimeLimit(String tl)
         second,
     };
 
-    ExecutionPlan::Clock::duration d;
+    ExecutionPlan::Clock::duration d{};
 
     size_t idx = 0, n;
     int t = none;
@@ -254,6 +280,26 @@ SwBuild::~SwBuild()
 {
 }
 
+path SwBuild::getSavedConfigsFilename() const
+{
+    return getBuildDirectory() / "misc" / (get_base_settings_name() + ".snapshot");
+}
+
+const TargetGraph &SwBuild::getTargetGraph() const
+{
+    // targets do not change after prepare
+    if (!target_graph)
+        target_graph = std::make_unique<TargetGraph>(getTargets());
+    return *target_graph;
+}
+
+const SavedConfigs &SwBuild::getSavedConfigs() const
+{
+    if (!saved_configs)
+        saved_configs = std::make_unique<SavedConfigs>(getSavedConfigsFilename());
+    return *saved_configs;
+}
+
 path SwBuild::getBuildDirectory() const
 {
     return build_dir;
@@ -285,6 +331,22 @@ void SwBuild::build()
 
     ScopedTime t;
 
+    SCOPE_EXIT
+    {
+        // trace is saved after execution, save what we have on earlier errors
+        if (build_settings["time_trace"] != "true" || state == BuildState::Executed)
+            return;
+        try
+        {
+            ExecutionPlan::saveChromeTrace(getBuildDirectory() / "misc" / "time_trace.json", {});
+        }
+        catch (std::exception &e)
+        {
+            LOG_WARN(logger, "Cannot save time trace: " << e.what());
+        }
+        TimeTrace::get().reset();
+    };
+
     // this is all in one call
     while (step())
         ;
@@ -300,22 +362,37 @@ bool SwBuild::step()
     switch (state)
     {
     case BuildState::NotStarted:
+    {
         // load provided inputs
+        TimeTrace::Scope ts("loadInputs");
         loadInputs();
         break;
+    }
     case BuildState::InputsLoaded:
+    {
+        TimeTrace::Scope ts("setTargetsToBuild");
         setTargetsToBuild();
         break;
+    }
     case BuildState::TargetsToBuildSet:
+    {
+        TimeTrace::Scope ts("resolvePackages");
         resolvePackages();
         break;
+    }
     case BuildState::PackagesResolved:
+    {
+        TimeTrace::Scope ts("loadPackages");
         loadPackages();
         break;
+    }
     case BuildState::PackagesLoaded:
+    {
         // prepare targets
+        TimeTrace::Scope ts("prepare");
         prepare();
         break;
+    }
     case BuildState::Prepared:
         // create ex. plan and execute it
         execute();
@@ -419,6 +496,7 @@ void SwBuild::resolvePackages(const std::vector<IDependency*> &udeps)
     // more complex lock file will be
     // when we able to set dependency per each target with its settings
     bool must_update_lock_file = true;
+    std::unordered_map<UnresolvedPackage, PackageId> locked;
     if (1
         && build_settings["update_lock_file"] != "true" // update flag
         && build_settings["lock_file"].isValue()
@@ -427,20 +505,38 @@ void SwBuild::resolvePackages(const std::vector<IDependency*> &udeps)
     {
         must_update_lock_file = false; // no need to update, we are loading
 
-        auto m = loadLockFile(build_settings["lock_file"].getValue());
+        locked = loadLockFile(build_settings["lock_file"].getValue());
+        auto m = locked;
         if (build_settings["update_lock_file_packages"])
         {
-            for (auto &[u, p] : build_settings["update_lock_file_packages"].getMap())
+            // partial update: named packages are resolved again, others stay locked
+            for (auto &[n, _] : build_settings["update_lock_file_packages"].getMap())
             {
-                m.erase(u);
+                auto u = extractFromString(n);
+                std::erase_if(m, [&u](const auto &v)
+                {
+                    return v.first == u || v.first.getPath() == u.getPath();
+                });
                 must_update_lock_file = true; // must update lock file here
             }
         }
         getContext().setCachedPackages(m);
+
+        // when everything is installed, packages are resolved from the cache
+        // and remote databases are not opened at all
+        auto &ls = getContext().getLocalStorage();
         UnresolvedPackages upkgs;
         for (auto &[u, p] : m)
-            upkgs.insert(p); // add exactly p, not u!
-        swctx.install(upkgs, false);
+        {
+            LocalPackage lp(ls, p);
+            if (!ls.isPackageInstalled(lp) && !ls.isPackageOverridden(p))
+                upkgs.insert(p); // add exactly p, not u!
+        }
+        if (!upkgs.empty())
+        {
+            LOG_DEBUG(logger, upkgs.size() << " locked packages are not installed, installing");
+            swctx.install(upkgs, false);
+        }
     }
 
     UnresolvedPackages upkgs;
@@ -454,6 +550,47 @@ void SwBuild::resolvePackages(const std::vector<IDependency*> &udeps)
     for (auto &[u, p] : m)
         targets[p];
 
+    // new or removed dependencies
+    if (!must_update_lock_file)
+    {
+        must_update_lock_file = m.size() != locked.size();
+        for (auto &[u, p] : m)
+        {
+            auto i = locked.find(u);
+            must_update_lock_file |= i == locked.end() || i->second != p;
+        }
+    }
+
+    if (build_settings["lock_file"].isValue() && must_update_lock_file)
+    {
+        // show fancy diffs during update lock file
+        if (build_settings["update_lock_file"] == "true")
+        try
+        {
+            // may throw
+            auto mold = loadLockFile(build_settings["lock_file"].getValue());
+            for (auto &[u, p] : mold)
+            {
+                auto i = m.find(u);
+                if (i == m.end())
+                    LOG_INFO(logger, "Deleting dependency  : " + u.toString() + " (" + p.toString() + ")");
+                else if (i->second != p)
+                    LOG_INFO(logger, "Updating dependency  : " + u.toString() + " (" + p.toString() + " -> " + i->second.toString() + ")");
+            }
+            for (auto &[u, p] : m)
+            {
+                auto i = mold.find(u);
+                if (i == mold.end())
+                    LOG_INFO(logger, "Adding new dependency: " + u.toString() + " -> " + p.toString());
+            }
+        }
+        catch (std::exception &)
+        {
+        }
+
+        saveLockFile(build_settings["lock_file"].getValue(), m);
+    }
+
     if (can_use_saved_configs(*this))
     {
         std::function<bool(const std::vector<IDependency*> &)> load_targets;
@@ -474,7 +611,7 @@ void SwBuild::resolvePackages(const std::vector<IDependency*> &udeps)
                 auto p = LocalPackage(getContext().getLocalStorage(), pi->first);
                 if (getTargets().find(p, d->getSettings()))
                     continue;
-                auto tgt = create_target(p, d->getSettings());
+                auto tgt = create_target(p, d->getSettings(), getSavedConfigs());
                 if (tgt)
                 {
                     getTargets()[tgt->getPackage()].push_back(tgt);
@@ -490,39 +627,6 @@ void SwBuild::resolvePackages(const std::vector<IDependency*> &udeps)
             return;
     }
 
-    if (build_settings["lock_file"].isValue() && must_update_lock_file)
-    {
-        // TODO: update for deps changes
-        SW_UNIMPLEMENTED;
-
-        // show fancy diffs during update lock file
-        if (build_settings["update_lock_file"] == "true")
-        try
-        {
-            // may throw
-            auto mold = loadLockFile(build_settings["lock_file"].getValue());
-            for (auto &[u, p] : mold)
-            {
-                auto i = m.find(u);
-                if (i == m.end())
-                    LOG_INFO(logger, "Deleting dependency  : " + u.toString() + " (" + p.toString() + ")");
-                else if (i->second != p)
-                    LOG_INFO(logger, "Updating dependency  : " + u.toString() + " (" + p.toString() + " -> " + i->second.toString() + ")");
-            }
-            for (auto &[u, p] : m)
-            {
-                auto i = mold.find(u);
-                if (i == mold.end())
-                    LOG_INFO(logger, "Adding new dependency: " + u.toString() + " -> " + p.toString());
-            }
-        }
-        catch (std::exception &)
-        {
-        }
-
-        saveLockFile(build_settings["lock_file"].getValue(), m);
-    }
-
     // now we know all drivers
     std::set<Input *> iv;
     for (auto &[u,p] : m)
@@ -538,6 +642,7 @@ void SwBuild::resolvePackages(const std::vector<IDependency*> &udeps)
 
     {
         ScopedTime t;
+        TimeTrace::Scope ts("loadEntryPoints");
         swctx.loadEntryPointsBatch(iv);
         if (build_settings["measure"] == "true")
             LOG_DEBUG(logger, "load entry points time: " << t.getTimeFloat() << " s.");
@@ -608,7 +713,7 @@ void SwBuild::loadPackages()
             if (usc)
             {
                 LocalPackage p(getContext().getLocalStorage(), d.first);
-                auto tgt = create_target(p, s);
+                auto tgt = create_target(p, s, getSavedConfigs());
                 if (tgt)
                 {
                     getTargets()[tgt->getPackage()].push_back(tgt);
@@ -683,6 +788,294 @@ void SwBuild::loadPackages()
     }
 }
 
+namespace
+{
+
+// runs target passes without global barriers
+//
+// a target starts its pass N when all its dependencies have finished pass N
+// and all its transitive dependents have finished pass N - 1 (or all their passes)
+// passes walk dependencies of dependencies (e.g. pass 3 collects link deps),
+// so both conditions must hold for the whole closure, not only for direct edges
+// (a target that finished all its passes does not hold back anything);
+// instead of closure edges nodes keep minimums over their closures
+// so a dependency (direct or not) is at most one pass ahead of its dependents
+// and it is never run together with them: dependent's pass N always sees it right after its pass N
+// (with barriers it was seen after pass N - 1, probably running pass N at the same time)
+// strongly connected targets are prepared together as one node
+struct PrepareScheduler
+{
+    static constexpr int all_passes = std::numeric_limits<int>::max();
+
+    struct Node
+    {
+        std::vector<ITarget *> targets;
+        std::vector<bool> targets_done;
+        std::vector<size_t> deps;
+        std::vector<size_t> dependents;
+        int pass = 1; // next pass to run
+        int completed = 0; // last finished pass
+        int deps_completed = 0; // min completed of the node and its transitive dependencies
+        int dependents_completed = 0; // min completed of the node and its transitive dependents
+        size_t blocked = 0; // deps and dependents not far enough for the next pass
+        bool running = false;
+    };
+
+    PrepareScheduler(const TargetMap &tm, Executor &e, const bool &stopped)
+        : e(e), stopped(stopped)
+    {
+        // graph
+        std::unordered_map<const ITarget *, size_t> ids;
+        std::vector<ITarget *> tgts;
+        for (const auto &[pkg, ts] : tm)
+        {
+            for (const auto &tgt : ts)
+            {
+                if (ids.emplace(tgt.get(), tgts.size()).second)
+                    tgts.push_back(tgt.get());
+            }
+        }
+        std::vector<std::vector<size_t>> edges(tgts.size());
+        for (size_t i = 0; i < tgts.size(); i++)
+        {
+            for (auto d : tgts[i]->getDependencies())
+            {
+                if (!d->isResolved())
+                    continue;
+                auto j = ids.find(&d->getTarget());
+                if (j != ids.end() && j->second != i)
+                    edges[i].push_back(j->second);
+            }
+        }
+
+        // tarjan, iterative: dependency chains may be long
+        std::vector<int> index(tgts.size(), -1), low(tgts.size());
+        std::vector<bool> on_stack(tgts.size());
+        std::vector<size_t> stack, node_of(tgts.size());
+        std::vector<std::pair<size_t, size_t>> calls; // target, next edge
+        int idx = 0;
+        auto visit = [&](size_t v)
+        {
+            index[v] = low[v] = idx++;
+            stack.push_back(v);
+            on_stack[v] = true;
+            calls.emplace_back(v, 0);
+        };
+        for (size_t root = 0; root < tgts.size(); root++)
+        {
+            if (index[root] != -1)
+                continue;
+            visit(root);
+            while (!calls.empty())
+            {
+                auto v = calls.back().first;
+                auto &e = calls.back().second;
+                if (e < edges[v].size())
+                {
+                    auto w = edges[v][e++];
+                    if (index[w] == -1)
+                        visit(w);
+                    else if (on_stack[w])
+                        low[v] = std::min(low[v], index[w]);
+                    continue;
+                }
+                calls.pop_back();
+                if (!calls.empty())
+                {
+                    auto p = calls.back().first;
+                    low[p] = std::min(low[p], low[v]);
+                }
+                if (low[v] != index[v])
+                    continue;
+                auto &n = nodes.emplace_back();
+                size_t w;
+                do
+                {
+                    w = stack.back();
+                    stack.pop_back();
+                    on_stack[w] = false;
+                    node_of[w] = nodes.size() - 1;
+                    n.targets.push_back(tgts[w]);
+                } while (w != v);
+                n.targets_done.resize(n.targets.size());
+            }
+        }
+
+        for (size_t v = 0; v < tgts.size(); v++)
+        {
+            for (auto w : edges[v])
+            {
+                auto a = node_of[v], b = node_of[w];
+                if (a != b)
+                    nodes[a].deps.push_back(b);
+            }
+        }
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            auto &n = nodes[i];
+            std::sort(n.deps.begin(), n.deps.end());
+            n.deps.erase(std::unique(n.deps.begin(), n.deps.end()), n.deps.end());
+            for (auto d : n.deps)
+                nodes[d].dependents.push_back(i);
+        }
+        for (auto &n : nodes)
+            n.blocked = countBlockers(n);
+    }
+
+    void run()
+    {
+        std::vector<size_t> ready;
+        {
+            std::unique_lock lk(m);
+            for (size_t i = 0; i < nodes.size(); i++)
+            {
+                if (nodes[i].blocked == 0)
+                    schedule(i, ready);
+            }
+        }
+        push(ready);
+
+        std::unique_lock lk(m);
+        cv.wait(lk, [this] { return running == 0; });
+        if (eptr)
+            std::rethrow_exception(eptr);
+        if (!stopped && finished != nodes.size())
+            throw SW_RUNTIME_ERROR("Not all targets were prepared");
+    }
+
+private:
+    Executor &e;
+    const bool &stopped;
+    std::vector<Node> nodes;
+    std::mutex m;
+    std::condition_variable cv;
+    size_t running = 0;
+    size_t finished = 0;
+    std::exception_ptr eptr;
+
+    // dependencies must finish the pass, transitive dependents must finish the previous one
+    size_t countBlockers(const Node &n) const
+    {
+        size_t b = 0;
+        for (auto d : n.deps)
+            b += nodes[d].deps_completed < n.pass;
+        for (auto d : n.dependents)
+            b += nodes[d].dependents_completed < n.pass - 1;
+        return b;
+    }
+
+    // under lock
+    void schedule(size_t i, std::vector<size_t> &ready)
+    {
+        if (eptr || stopped)
+            return;
+        nodes[i].running = true;
+        running++;
+        ready.push_back(i);
+    }
+
+    // without lock, executor may run tasks in place
+    void push(const std::vector<size_t> &ready)
+    {
+        for (auto i : ready)
+            e.push([this, i] { execute(i); });
+    }
+
+    void execute(size_t i)
+    {
+        std::vector<size_t> ready;
+        try
+        {
+            auto next_pass = prepare(nodes[i]);
+            std::unique_lock lk(m);
+            complete(i, next_pass, ready);
+        }
+        catch (...)
+        {
+            std::unique_lock lk(m);
+            if (!eptr)
+                eptr = std::current_exception();
+            nodes[i].running = false;
+        }
+        push(ready);
+
+        std::unique_lock lk(m);
+        if (--running == 0)
+            cv.notify_all();
+    }
+
+    // node data is not touched by the scheduler while running
+    static bool prepare(Node &n)
+    {
+        bool next_pass = false;
+        for (size_t i = 0; i < n.targets.size(); i++)
+        {
+            if (n.targets_done[i])
+                continue;
+            auto tgt = n.targets[i];
+            TimeTrace::Scope ts(tgt->getPackage().toString(), "prepare pass " + std::to_string(n.pass));
+            if (tgt->prepare())
+                next_pass = true;
+            else
+                n.targets_done[i] = true;
+        }
+        return next_pass;
+    }
+
+    // under lock
+    void complete(size_t i, bool next_pass, std::vector<size_t> &ready)
+    {
+        auto &n = nodes[i];
+        n.running = false;
+        n.completed = next_pass ? n.pass++ : all_passes;
+        if (!next_pass)
+            finished++;
+
+        // neighbours waiting for one of passes finished now
+        // blockers of running nodes are counted again when they complete
+        auto unblock = [this, &ready](size_t j, int required, int from, int to)
+        {
+            auto &jn = nodes[j];
+            if (jn.running || jn.completed == all_passes)
+                return;
+            if (from < required && required <= to && --jn.blocked == 0)
+                schedule(j, ready);
+        };
+        // minimums only grow, so every node is raised at most once per pass
+        auto raise = [this, &unblock, i](int Node::*v, std::vector<size_t> Node::*from, std::vector<size_t> Node::*to, int ahead)
+        {
+            std::vector<size_t> raised{ i };
+            while (!raised.empty())
+            {
+                auto &rn = nodes[raised.back()];
+                raised.pop_back();
+                auto c = rn.completed;
+                for (auto d : rn.*from)
+                    c = std::min(c, nodes[d].*v);
+                if (c <= rn.*v)
+                    continue;
+                auto prev = rn.*v;
+                rn.*v = c;
+                for (auto d : rn.*to)
+                {
+                    unblock(d, nodes[d].pass - ahead, prev, c);
+                    raised.push_back(d);
+                }
+            }
+        };
+        raise(&Node::deps_completed, &Node::deps, &Node::dependents, 0);
+        raise(&Node::dependents_completed, &Node::dependents, &Node::deps, 1);
+
+        if (!next_pass)
+            return;
+        n.blocked = countBlockers(n);
+        if (n.blocked == 0)
+            schedule(i, ready);
+    }
+};
+
+}
+
 bool SwBuild::prepareStep()
 {
     std::atomic_bool next_pass = false;
@@ -695,6 +1088,7 @@ bool SwBuild::prepareStep()
         {
             fs.push_back(e.push([tgt, &next_pass]
             {
+                TimeTrace::Scope ts(tgt->getPackage().toString(), "prepare");
                 if (tgt->prepare())
                     next_pass = true;
             }));
@@ -709,8 +1103,10 @@ void SwBuild::prepare()
 {
     CHECK_STATE_AND_CHANGE(BuildState::PackagesLoaded, BuildState::Prepared);
 
-    while (prepareStep() && !stopped)
-        ;
+    {
+        TimeTrace::Scope ts("prepare");
+        PrepareScheduler(getTargets(), getPrepareExecutor(), stopped).run();
+    }
     if (stopped)
         return;
 
@@ -718,6 +1114,7 @@ void SwBuild::prepare()
         return;
 
     // save after prepare
+    std::vector<SavedConfigs::Entry> entries;
     for (const auto &[pkg, tgts] : targets)
     {
         if (!pkg.getPath().isAbsolute())
@@ -727,16 +1124,18 @@ void SwBuild::prepare()
             LocalPackage p(getContext().getLocalStorage(), tgt->getPackage());
             if (p.isOverridden())
                 continue;
+            auto cfg = tgt->getSettings().getHash();
+            auto hash = tgt->getInterfaceSettings().getHash();
+            entries.push_back({ p.toString(), cfg, hash, &tgt->getInterfaceSettings() });
             // skip predefs - they are already readed from disk or created in sw
             if (tgt->as<const PredefinedTarget *>())
                 continue;
-            auto cfg = tgt->getSettings().getHash();
             auto base = p.getDirObj(cfg);
             auto sfn = base / get_settings_fn();
             auto sfncfg = base / get_base_settings_name() += ".cfg";
             auto sptrfn = base / "settings.hash";
 
-            if (!fs::exists(sfn) || !fs::exists(sptrfn) || read_file(sptrfn) != tgt->getInterfaceSettings().getHash())
+            if (!fs::exists(sfn) || !fs::exists(sptrfn) || read_file(sptrfn) != hash)
             {
                 if (!use_json())
                     saveSettings(sfn, tgt->getInterfaceSettings());
@@ -745,15 +1144,26 @@ void SwBuild::prepare()
                     write_file(sfn, nlohmann::json::parse(tgt->getInterfaceSettings().toString()).dump(2));
                     write_file(sfncfg, nlohmann::json::parse(tgt->getSettings().toString()).dump(2));
                 }
-                write_file(sptrfn, tgt->getInterfaceSettings().getHash());
+                write_file(sptrfn, hash);
             }
         }
     }
+
+    // one file for the next run instead of parsing json of every target
+    if (!getSavedConfigs().matches(entries))
+    {
+        SavedConfigs::save(getSavedConfigsFilename(), entries);
+        saved_configs.reset();
+    }
 }
 
 void SwBuild::execute() const
 {
-    auto p = getExecutionPlan();
+    std::unique_ptr<ExecutionPlan> p;
+    {
+        TimeTrace::Scope ts("getExecutionPlan");
+        p = getExecutionPlan();
+    }
     execute(*p);
 }
 
@@ -763,6 +1173,14 @@ void SwBuild::execute(ExecutionPlan &p) const
 
     SwapAndRestore sr(current_explan, &p);
 
+    openExplainLog(getBuildDirectory());
+    SCOPE_EXIT
+    {
+        closeExplainLog();
+        // failed builds resolve programs too
+        saveExecutableCache();
+    };
+
     p.build_always |= build_settings["build_always"] == "true";
     p.write_output_to_file |= build_settings["write_output_to_file"] == "true";
     if (build_settings["skip_errors"].isValue())
@@ -771,12 +1189,18 @@ void SwBuild::execute(ExecutionPlan &p) const
         p.setTimeLimit(parseTimeLimit(build_settings["time_limit"].getValue()));
 
     ScopedTime t;
-    p.execute(getBuildExecutor());
+    {
+        TimeTrace::Scope ts("execute");
+        p.execute(getBuildExecutor());
+    }
     if (build_settings["measure"] == "true")
         LOG_DEBUG(logger, BOOST_CURRENT_FUNCTION << " time: " << t.getTimeFloat() << " s.");
 
     if (build_settings["time_trace"] == "true")
+    {
         p.saveChromeTrace(getBuildDirectory() / "misc" / "time_trace.json");
+        TimeTrace::get().reset();
+    }
 
     path ide_fast_path = build_settings["build_ide_fast_path"].isValue() ? build_settings["build_ide_fast_path"].getValue() : "";
     if (!ide_fast_path.empty())
@@ -822,11 +1246,10 @@ Commands SwBuild::getCommands() const
     }
     bool in_ttb_used = !in_ttb.empty();
 
-    decltype(targets_to_build) ttb;
+    const auto &g = getTargetGraph();
 
-    // detect all targets to build
-    // some static builds won't build deps, because there's no dependent link files
-    // (e.g. build static png, zlib won't be built)
+    decltype(targets_to_build) ttb;
+    std::vector<size_t> roots;
     for (auto &[p, tgts] : targets_to_build)
     {
         if (in_ttb_used)
@@ -842,63 +1265,8 @@ Commands SwBuild::getCommands() const
         }
 
         ttb.emplace(p, tgts);
-
         for (auto &tgt : tgts)
-        {
-            // gather targets to build
-            const auto &s = tgt->getInterfaceSettings();
-
-            // skip prebuilt
-            //if (auto t = tgt->as<const PredefinedTarget *>())
-                //continue;
-
-            std::function<void(const TargetSettings &)> gather_ttb;
-            gather_ttb = [this, &gather_ttb, &ttb](const auto &s) mutable
-            {
-                if (s["header_only"] == "true")
-                    return;
-
-                if (!(s["type"] == "native_shared_library" || s["type"] == "native_static_library" || s["type"] == "native_executable"))
-                    return;
-
-                std::function<void(const TargetSettings &)> process_deps;
-                process_deps = [this, &gather_ttb, &process_deps, &ttb](const auto &s) mutable
-                {
-                    auto get_deps = [this, &gather_ttb, &process_deps, &ttb](const auto &in)
-                    {
-                        for (auto &[k, v] : in)
-                        {
-                            auto i = getTargets().find(PackageId(k));
-                            if (i == getTargets().end())
-                                throw SW_RUNTIME_ERROR("dep not found: " + k);
-                            auto j = i->second.findSuitable(v.getMap());
-                            if (j == i->second.end())
-                            {
-                                LOG_TRACE(logger, "dep+settings not found: " + k + ": " + v.getMap().toString());
-                                continue; // probably was loaded config
-                                //throw SW_RUNTIME_ERROR("dep+settings not found: " + k + ": " + v.getMap().toString());
-                            }
-
-                            auto m = ttb[PackageId(k)].findEqual((*j)->getSettings());
-                            if (m != ttb[PackageId(k)].end())
-                                continue;
-                            ttb[PackageId(k)].push_back(*j);
-
-                            const auto &s = (*j)->getInterfaceSettings();
-                            gather_ttb(s);
-                            process_deps(s);
-                        }
-                    };
-
-                    get_deps(s["dependencies"]["link"].getMap());
-                    get_deps(s["dependencies"]["dummy"].getMap());
-                };
-
-                process_deps(s);
-            };
-
-            gather_ttb(s);
-        }
+            roots.push_back(g.getIndex(*tgt));
     }
 
     if (!in_ttb.empty())
@@ -910,6 +1278,15 @@ Commands SwBuild::getCommands() const
         throw SW_RUNTIME_ERROR("Cannot make targets: " + s + ": no such targets");
     }
 
+    // detect all targets to build
+    for (auto i : g.getBuildClosure(roots))
+    {
+        auto &t = g.getNode(i).target;
+        auto &c = ttb[t->getPackage()];
+        if (c.findEqual(t->getSettings()) == c.end())
+            c.push_back(t);
+    }
+
     // update public ttb
     // reconsider? remove?
     targets_to_build = ttb;
@@ -936,7 +1313,67 @@ Commands SwBuild::getCommands() const
     // copy output files
     path copy_dir = build_settings["build_ide_copy_to_dir"].isValue() ? build_settings["build_ide_copy_to_dir"].getValue() : "";
     {
-        std::unordered_map<path, path> copy_files;
+        // native binaries needed at runtime: the target and everything it links
+        // non native deps (header only) are walked through, but not returned
+        // memoized, so shared subgraphs are walked once
+        const auto &nodes = g.getNodes();
+        std::vector<std::vector<size_t>> runtime_deps(nodes.size());
+        std::vector<uint8_t> runtime_deps_state(nodes.size()); // 0 - new, 1 - in progress, 2 - done
+        bool cyclic = false;
+        std::function<const std::vector<size_t> &(size_t)> get_runtime_deps;
+        get_runtime_deps = [&nodes, &runtime_deps, &runtime_deps_state, &cyclic, &get_runtime_deps](size_t i) -> const std::vector<size_t> &
+        {
+            auto &r = runtime_deps[i];
+            if (runtime_deps_state[i] == 1)
+                cyclic = true;
+            if (runtime_deps_state[i])
+                return r;
+            runtime_deps_state[i] = 1;
+            auto &n = nodes[i];
+            if (!n.unresolved_link.empty())
+                throw SW_RUNTIME_ERROR("dep+settings not found: " + n.unresolved_link[0]);
+            if (n.native)
+                r.push_back(i);
+            for (auto d : n.link)
+            {
+                auto &r2 = get_runtime_deps(d);
+                r.insert(r.end(), r2.begin(), r2.end());
+            }
+            std::sort(r.begin(), r.end());
+            r.erase(std::unique(r.begin(), r.end()), r.end());
+            runtime_deps_state[i] = 2;
+            return r;
+        };
+        // results of nodes on a cycle may be incomplete, plain walk is used then
+        auto walk_runtime_deps = [&nodes](size_t root)
+        {
+            std::vector<size_t> r;
+            std::vector<bool> visited(nodes.size());
+            std::vector<size_t> q{ root };
+            visited[root] = true;
+            while (!q.empty())
+            {
+                auto i = q.back();
+                q.pop_back();
+                auto &n = nodes[i];
+                if (!n.unresolved_link.empty())
+                    throw SW_RUNTIME_ERROR("dep+settings not found: " + n.unresolved_link[0]);
+                if (n.native)
+                    r.push_back(i);
+                for (auto d : n.link)
+                {
+                    if (!visited[d])
+                    {
+                        visited[d] = true;
+                        q.push_back(d);
+                    }
+                }
+            }
+            return r;
+        };
+
+        std::vector<bool> outputs_added(nodes.size());
+        std::unordered_map<path, path> copy_files; // to -> from
         for (auto &[p, tgts] : ttb)
         {
             // BUG: currently we copy several configs into single files, this is wrong
@@ -959,89 +1396,58 @@ Commands SwBuild::getCommands() const
                 if (!copy_ok)
                     continue;
 
+                auto i = g.getIndex(*tgt);
+                if (!nodes[i].native)
+                    continue;
+
                 auto copy_dir_current = copy_dir;
                 // copy only for local targets
                 if (copy_dir_current.empty())
                 {
                     if (p.getPath().isAbsolute())
                         continue;
-                    if (s["header_only"] == "true")
-                        continue;
-                    if (!(s["type"] == "native_shared_library" || s["type"] == "native_static_library" || s["type"] == "native_executable"))
-                        continue;
                     copy_dir_current = s["output_file"].getPathValue(getContext().getLocalStorage()).parent_path();
                 }
 
-                PackageIdSet visited_pkgs;
-                std::function<void(const TargetSettings &)> copy_file;
-                copy_file = [this, &copy_dir_current, &copy_files, &copy_file, &visited_pkgs](const auto &s)
+                std::vector<size_t> walked;
+                auto deps = &get_runtime_deps(i);
+                if (cyclic)
                 {
-                    if (s["header_only"] == "true")
-                        return;
-
-                    if (!(s["type"] == "native_shared_library" || s["type"] == "native_static_library" || s["type"] == "native_executable"))
-                        return;
-
+                    walked = walk_runtime_deps(i);
+                    deps = &walked;
+                }
+                for (auto d : *deps)
+                {
+                    const auto &s = nodes[d].target->getInterfaceSettings();
                     auto in = s["output_file"].getPathValue(getContext().getLocalStorage());
-                    fast_path_files.insert(in);
-
-                    if (s["import_library"].isValue())
+                    if (!outputs_added[d])
                     {
-                        path il = s["import_library"].getPathValue(getContext().getLocalStorage());
-                        fast_path_files.insert(il);
+                        outputs_added[d] = true;
+                        fast_path_files.insert(in);
+                        if (s["import_library"].isValue())
+                            fast_path_files.insert(s["import_library"].getPathValue(getContext().getLocalStorage()));
                     }
 
-                    if (s["type"] == "native_shared_library"
-                        // copy only for wintgt?
-                        //&& PackagePath(s["os"]["kernel"].getValue()) == PackagePath("com.Microsoft.Windows.NT")
-                        )
-                    {
-                        auto o = copy_dir_current;
-                        if (s["output_dir"].isValue())
-                            o /= s["output_dir"].getValue();
-                        o /= in.filename();
-                        if (in == o)
-                            return;
-                        if (copy_files.find(in) != copy_files.end())
-                            return;
-                        copy_files[in] = o;
+                    // copy only for wintgt?
+                    if (!nodes[d].shared)
+                        continue;
+                    auto o = copy_dir_current;
+                    if (s["output_dir"].isValue())
+                        o /= s["output_dir"].getValue();
+                    o /= in.filename();
+                    if (in == o)
+                        continue;
+                    // same destination may be reached from many targets
+                    if (copy_files.emplace(o, in).second)
                         fast_path_files.insert(o);
-                    }
-
-                    std::function<void(const TargetSettings &)> process_deps;
-                    process_deps = [this, &copy_file, &process_deps, &visited_pkgs](const auto &s)
-                    {
-                        for (auto &[k, v] : s["dependencies"]["link"].getMap())
-                        {
-                            PackageId p(k);
-                            if (visited_pkgs.find(p) != visited_pkgs.end())
-                                continue;
-                            visited_pkgs.insert(p);
-                            auto i = getTargets().find(p);
-                            if (i == getTargets().end())
-                                throw SW_RUNTIME_ERROR("dep not found");
-                            auto j = i->second.findSuitable(v.getMap());
-                            if (j == i->second.end())
-                                throw SW_RUNTIME_ERROR("dep+settings not found");
-
-                            const auto &s = (*j)->getInterfaceSettings();
-                            copy_file(s);
-                            process_deps(s);
-                        }
-                    };
-
-                    process_deps(s);
-                };
-
-                copy_file(s);
+                }
             }
         }
 
-        for (auto &[f, t] : copy_files)
+        for (auto &[t, f] : copy_files)
         {
             auto copy_cmd = std::make_shared<::sw::builder::BuiltinCommand>(*this, SW_VISIBLE_BUILTIN_FUNCTION(copy_file));
-            copy_cmd->arguments.push_back(f);
-            copy_cmd->arguments.push_back(t);
+            copy_cmd->setFunction(builder::copyFile, f, t);
             copy_cmd->addInput(f);
             copy_cmd->addOutput(t);
             //copy_cmd->dependencies.insert(nt->getCommand());
@@ -1225,6 +1631,12 @@ void SwBuild::setSettings(const TargetSettings &bs)
         build_executor = std::make_unique<Executor>(std::stoi(build_settings["build-jobs"].getValue()));
     if (build_settings["prepare-jobs"])
         prepare_executor = std::make_unique<Executor>(std::stoi(build_settings["prepare-jobs"].getValue()));
+    // previous builds of the process (daemon) must not get into this trace
+    TimeTrace::get().reset();
+    if (build_settings["time_trace"] == "true")
+        TimeTrace::get().enable();
+    if (build_settings["build-memory"])
+        getMemoryPool().setLimit(std::stoll(build_settings["build-memory"].getValue()) << 20);
 }
 
 Executor &SwBuild::getBuildExecutor() const
@@ -1251,63 +1663,397 @@ path SwBuild::getTestDir() const
     return getBuildDirectory() / "test";
 }
 
+namespace
+{
+
+// results of previous test runs, used for ordering and reruns
+struct TestResults
+{
+    struct Result
+    {
+        int64_t duration = -1; // ms, -1 - unknown
+        bool passed = false;
+        size_t state = 0; // test command and its inputs
+    };
+
+    TestResults(const path &fn)
+        : fn(fn)
+    {
+        if (!fs::exists(fn))
+            return;
+        try
+        {
+            auto j = nlohmann::json::parse(read_file(fn));
+            for (auto &[k, v] : j.items())
+            {
+                auto &r = results[k];
+                r.duration = v["duration"];
+                r.passed = v["passed"];
+                r.state = v["state"];
+            }
+        }
+        catch (std::exception &e)
+        {
+            LOG_DEBUG(logger, "Cannot load test results, ignoring: " << e.what());
+            results.clear();
+        }
+    }
+
+    void save() const
+    {
+        nlohmann::json j;
+        for (auto &[k, r] : results)
+        {
+            auto &v = j[k];
+            v["duration"] = r.duration;
+            v["passed"] = r.passed;
+            v["state"] = r.state;
+        }
+        auto t = path(fn) += ".tmp";
+        write_file(t, j.dump(2));
+        fs::rename(t, fn);
+    }
+
+    const Result *find(const String &k) const
+    {
+        auto i = results.find(k);
+        return i == results.end() ? nullptr : &i->second;
+    }
+
+    Result &operator[](const String &k) { return results[k]; }
+
+private:
+    path fn;
+    std::map<String, Result> results;
+};
+
+static size_t getTestState(const builder::Command &c)
+{
+    // changed program or inputs make test affected
+    auto h = c.getHash();
+    auto add_file = [&h](const path &p)
+    {
+        std::error_code ec;
+        auto t = fs::last_write_time(p, ec);
+        hash_combine(h, ec ? 0 : t.time_since_epoch().count());
+    };
+    add_file(c.getProgram());
+    for (auto &i : c.inputs)
+        add_file(i);
+    return h;
+}
+
+}
+
 void SwBuild::test()
 {
     build();
-
+
     auto dir = getTestDir();
 
+    // options
+    const auto &s = getSettings();
+    int shard = 1, n_shards = 1;
+    if (s["test-shard"].isValue())
+    {
+        auto &v = s["test-shard"].getValue();
+        auto p = v.find('/');
+        try
+        {
+            if (p == v.npos)
+                throw std::runtime_error("missing '/'");
+            shard = std::stoi(v.substr(0, p));
+            n_shards = std::stoi(v.substr(p + 1));
+        }
+        catch (std::exception &)
+        {
+            throw SW_RUNTIME_ERROR("Bad test shard '" + v + "', expected i/N");
+        }
+        if (n_shards < 1 || shard < 1 || shard > n_shards)
+            throw SW_RUNTIME_ERROR("Bad test shard '" + v + "', expected 1 <= i <= N");
+    }
+    std::chrono::milliseconds timeout{ 0 };
+    if (s["test-timeout"].isValue())
+        timeout = std::chrono::duration_cast<std::chrono::milliseconds>(parseTimeLimit(s["test-timeout"].getValue()));
+    int jobs = 0;
+    if (s["test-jobs"].isValue())
+        jobs = std::stoi(s["test-jobs"].getValue());
+    String rerun;
+    if (s["test-rerun"].isValue())
+    {
+        rerun = s["test-rerun"].getValue();
+        if (rerun != "failed" && rerun != "affected")
+            throw SW_RUNTIME_ERROR("Unknown test rerun mode: " + rerun + ", expected failed or affected");
+    }
+
+    TestResults results(dir / "results.json");
+
     // remove only test dirs for active configs
-    Files tdirs;
-    for (const auto &[pkg, tgts] : getTargetsToBuild())
+    if (rerun.empty())
     {
-        for (auto &tgt : tgts)
+        Files tdirs;
+        for (const auto &[pkg, tgts] : getTargetsToBuild())
         {
-            auto test_dir = dir / tgt->getSettings().getHash();
-            tdirs.insert(test_dir);
+            for (auto &tgt : tgts)
+            {
+                auto test_dir = dir / tgt->getSettings().getHash();
+                tdirs.insert(test_dir);
+            }
         }
+        for (auto &d : tdirs)
+            fs::remove_all(d);
     }
-    for (auto &d : tdirs)
-        fs::remove_all(d);
 
-    // prepare
+    // select and prepare
+    struct Test
+    {
+        std::shared_ptr<builder::Command> c;
+        String key;
+        size_t state;
+        int64_t duration;
+    };
+    std::vector<Test> tests;
+    size_t n_total = 0;
     for (const auto &[pkg, tgts] : getTargetsToBuild())
     {
         for (auto &tgt : tgts)
         {
             for (auto &c : tgt->getTests())
             {
+                n_total++;
+                auto name = "test: [" + tgt->getPackage().toString() + "]/" + c->name;
+                auto key = tgt->getSettings().getHash() + " " + name;
+
+                // must be stable between machines
+                if (n_shards > 1 && std::stoull(shorten_hash(blake2b_512(key), 8), nullptr, 16) % n_shards != shard - 1)
+                    continue;
+
+                c->prepare();
+                auto state = getTestState(*c);
+                auto r = results.find(key);
+                if (rerun == "failed" && (!r || r->passed))
+                    continue;
+                if (rerun == "affected" && r && r->passed && r->state == state)
+                    continue;
+
                 auto test_dir_name = c->getName();
                 // don't go deeper for now?
                 boost::replace_all(test_dir_name, "/", ".");
                 boost::replace_all(test_dir_name, "\\", ".");
                 auto test_dir = dir / tgt->getSettings().getHash() / tgt->getPackage().toString() / test_dir_name;
+                if (!rerun.empty())
+                    fs::remove_all(test_dir);
                 fs::create_directories(test_dir);
 
-                //
-                c->name = "test: [" + tgt->getPackage().toString() + "]/" + c->name;
-                c->always = true;
-                c->working_directory = test_dir;
-                //c.addPathDirectory(BinaryDir / getSettings().getConfig());
-                c->out.file = test_dir / "stdout.txt";
+                //
+                c->name = name;
+                c->always = true;
+                c->working_directory = test_dir;
+                //c.addPathDirectory(BinaryDir / getSettings().getConfig());
+                c->out.file = test_dir / "stdout.txt";
                 c->err.file = test_dir / "stderr.txt";
+                if (timeout.count() && !c->timeout.count())
+                    c->timeout = timeout;
+                if (jobs > 0 && !c->pool)
+                    c->pool = getResourcePool("test", jobs);
+
+                tests.push_back({ c, key, state, r ? r->duration : -1 });
             }
         }
     }
 
+    LOG_INFO(logger, "Running " << tests.size() << " of " << n_total << " tests"
+        << (n_shards > 1 ? " (shard " + std::to_string(shard) + "/" + std::to_string(n_shards) + ")" : ""s));
+    if (tests.empty())
+        return;
+
+    // longest first, so long tests do not finish the run alone; new tests are considered the longest
+    std::stable_sort(tests.begin(), tests.end(), [](const auto &t1, const auto &t2)
+    {
+        if (t1.duration == -1 || t2.duration == -1)
+            return t1.duration == -1 && t2.duration != -1;
+        return t1.duration > t2.duration;
+    });
+
     // gather commands
     Commands cmds;
+    int order = 0;
+    for (auto &t : tests)
+    {
+        t.c->strict_order = ++order;
+        cmds.insert(t.c);
+    }
+
+    auto ep = getExecutionPlan(cmds);
+    // run all tests and report failures at the end
+    ep->throw_on_errors = false;
+    ep->skip_errors = tests.size() + 1;
+    if (s["time_limit"].isValue())
+        ep->setTimeLimit(parseTimeLimit(s["time_limit"].getValue()));
+
+    auto save_results = [&tests, &results]()
+    {
+        Strings failed;
+        for (auto &t : tests)
+        {
+            auto &c = *t.c;
+            if (!c.isExecuted())
+                continue;
+            auto &r = results[t.key];
+            r.passed = !c.timed_out && c.exit_code && *c.exit_code == 0;
+            r.state = t.state;
+            if (c.t_end > c.t_begin)
+                r.duration = std::chrono::duration_cast<std::chrono::milliseconds>(c.t_end - c.t_begin).count();
+            if (!r.passed)
+                failed.push_back(c.getName() + (c.timed_out ? " (timed out)" : ""));
+        }
+        results.save();
+        return failed;
+    };
+
+    try
+    {
+        ep->execute(::getExecutor());
+    }
+    catch (...)
+    {
+        save_results();
+        throw;
+    }
+
+    auto failed = save_results();
+    if (failed.empty())
+    {
+        LOG_INFO(logger, "All tests passed");
+        return;
+    }
+    for (auto &f : failed)
+        LOG_ERROR(logger, "Failed: " << f);
+    throw SW_RUNTIME_ERROR(std::to_string(failed.size()) + " of " + std::to_string(tests.size()) + " tests failed");
+}
+
+std::unordered_set<const ITarget *> SwBuild::getAffectedTargets(const Files &changed_files) const
+{
+    CHECK_STATE(BuildState::Prepared);
+
+    std::unordered_set<path> changed;
+    for (auto &f : changed_files)
+        changed.insert(normalize_path(f));
+    auto is_changed = [&changed](const path &p)
+    {
+        return changed.contains(normalize_path(p));
+    };
+
+    const auto &nodes = getTargetGraph().getNodes();
+    std::vector<const ITarget *> all;
+    for (auto &n : nodes)
+        all.push_back(n.target.get());
+
+    std::unordered_set<const ITarget *> affected;
+
+    // changed build scripts may change anything
+    for (auto &i : getInputs())
+    {
+        for (auto &f : i.getInput().getInput().getSpecification().getFiles())
+        {
+            if (is_changed(f))
+                return { all.begin(), all.end() };
+        }
+    }
+
+    std::vector<size_t> q;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        auto t = all[i];
+        // own files (sources, headers)
+        bool a = false;
+        for (auto &[f, _] : t->getFiles(StorageFileType::SourceArchive))
+        {
+            if ((a = is_changed(f)))
+                break;
+        }
+
+        // inputs of commands and their implicit inputs (included files) from the previous build
+        if (!a)
+        {
+            for (auto &c : t->getCommands())
+            {
+                for (auto &f : c->inputs)
+                {
+                    if ((a = is_changed(f)))
+                        break;
+                }
+                if (a || !c->command_storage)
+                    continue;
+                auto r = c->command_storage->getStorage().find(c->getHash());
+                if (!r)
+                    continue;
+                for (auto &f : r->getImplicitInputs(c->command_storage->getInternalStorage()))
+                {
+                    if ((a = is_changed(f)))
+                        break;
+                }
+                if (a)
+                    break;
+            }
+        }
+        if (a)
+        {
+            affected.insert(t);
+            q.push_back(i);
+        }
+    }
+
+    // dependents
+    while (!q.empty())
+    {
+        auto i = q.back();
+        q.pop_back();
+        for (auto d : nodes[i].dependents)
+        {
+            if (affected.insert(all[d]).second)
+                q.push_back(d);
+        }
+    }
+
+    LOG_DEBUG(logger, "Changed files: " << changed.size() << ", affected targets: " << affected.size() << " of " << all.size());
+    return affected;
+}
+
+Commands SwBuild::getAffectedTests(const std::unordered_set<const ITarget *> &affected) const
+{
+    // tests may run programs of other targets
+    std::unordered_set<path> outputs;
+    for (auto t : affected)
+    {
+        for (auto &c : t->getCommands())
+        {
+            for (auto &o : c->outputs)
+                outputs.insert(normalize_path(o));
+        }
+    }
+
+    Commands tests;
     for (const auto &[pkg, tgts] : getTargetsToBuild())
     {
         for (auto &tgt : tgts)
         {
-            auto c = tgt->getTests();
-            cmds.insert(c.begin(), c.end());
+            for (auto &c : tgt->getTests())
+            {
+                if (!affected.contains(tgt.get()))
+                {
+                    c->prepare();
+                    auto a = outputs.contains(normalize_path(c->getProgram()));
+                    for (auto &f : c->inputs)
+                        a |= outputs.contains(normalize_path(f));
+                    if (!a)
+                        continue;
+                }
+                tests.insert(c);
+            }
         }
     }
-
-    auto ep = getExecutionPlan(cmds);
-    ep->execute(::getExecutor());
+    return tests;
 }
 
 bool SwBuild::isPredefinedTarget(const PackagePath &pp) const
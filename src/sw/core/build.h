@@ -13,7 +13,9 @@ namespace sw
 struct ExecutionPlan;
 struct Input;
 struct InputWithSettings;
+struct SavedConfigs;
 struct SwContext;
+struct TargetGraph;
 
 enum class BuildState
 {
@@ -82,6 +84,15 @@ struct SW_CORE_API SwBuild : SwBuilderContext
     void test();
     path getTestDir() const;
 
+    // affected by changed files, build must be prepared
+    /// targets owning or including changed files and their dependents
+    std::unordered_set<const ITarget *> getAffectedTargets(const Files &changed) const;
+    /// tests of affected targets and tests running their outputs
+    Commands getAffectedTests(const std::unordered_set<const ITarget *> &) const;
+
+    /// resolved dependencies of all targets, built once, build must be prepared
+    const TargetGraph &getTargetGraph() const;
+
     //
     TargetMap &getTargets() { return targets; }
     const TargetMap &getTargets() const { return targets; }
@@ -120,6 +131,8 @@ private:
     std::unique_ptr<Executor> prepare_executor;
     bool stopped = false;
     mutable ExecutionPlan *current_explan = nullptr;
+    mutable std::unique_ptr<SavedConfigs> saved_configs;
+    mutable std::unique_ptr<TargetGraph> target_graph;
 
     // other data
     String name;
@@ -129,6 +142,8 @@ private:
     void resolvePackages(const std::vector<IDependency*> &upkgs); // [2/2] step
     Executor &getBuildExecutor() const;
     Executor &getPrepareExecutor() const;
+    const SavedConfigs &getSavedConfigs() const;
+    path getSavedConfigsFilename() const;
 };
 
 } // namespace sw
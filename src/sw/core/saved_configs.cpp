@@ -0,0 +1,361 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "saved_configs.h"
+
+#include <nlohmann/json.hpp>
+#include <primitives/exceptions.h>
+#include <pystring.h>
+
+#include <cstring>
+#include <fstream>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "saved_configs");
+
+// header | records | string table | record index
+//
+// record: package, config, interface hash, settings
+// settings are stored as json values of TargetSettings::toString(),
+// so loading gives the same result as parsing saved json
+// all strings are interned
+
+namespace sw
+{
+
+static const char sc_magic[4] = { 'S', 'W', 'S', 'C' };
+// bump on any format change
+static const uint32_t sc_version = 1;
+
+namespace
+{
+
+struct SavedConfigsHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t size; // of the whole file
+    uint64_t strings_offset;
+    uint64_t index_offset;
+    uint32_t n_strings;
+    uint32_t n_records;
+};
+
+enum SavedConfigsValueType : uint8_t
+{
+    ScNull,
+    ScString,
+    ScArray,
+    ScObject,
+};
+
+struct SavedConfigsWriter
+{
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> index;
+
+    SavedConfigsWriter()
+    {
+        data.resize(sizeof(SavedConfigsHeader));
+    }
+
+    template <class T>
+    void write(const T &v)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto p = (const uint8_t *)&v;
+        data.insert(data.end(), p, p + sizeof(T));
+    }
+
+    void writeString(const String &s)
+    {
+        auto [i, inserted] = ids.try_emplace(s, (uint32_t)strings.size());
+        if (inserted)
+            strings.push_back(&i->first);
+        write(i->second);
+    }
+
+    void writeValue(const nlohmann::json &j)
+    {
+        if (j.is_object())
+        {
+            write(ScObject);
+            write((uint32_t)j.size());
+            for (auto &[k, v] : j.items())
+            {
+                writeString(k);
+                writeValue(v);
+            }
+        }
+        else if (j.is_array())
+        {
+            write(ScArray);
+            write((uint32_t)j.size());
+            for (auto &v : j)
+                writeValue(v);
+        }
+        else if (j.is_string())
+        {
+            write(ScString);
+            writeString(j.get<String>());
+        }
+        else if (j.is_null())
+            write(ScNull);
+        else
+            throw SW_RUNTIME_ERROR("Bad json value. Only objects, arrays and strings are currently accepted.");
+    }
+
+    void writeRecord(const SavedConfigs::Entry &e)
+    {
+        index.push_back(data.size());
+        writeString(e.package);
+        writeString(e.config);
+        writeString(e.hash);
+        writeValue(nlohmann::json::parse(e.settings->toString()));
+    }
+
+    void finish()
+    {
+        SavedConfigsHeader h{};
+        memcpy(h.magic, sc_magic, sizeof(sc_magic));
+        h.version = sc_version;
+        h.strings_offset = data.size();
+        h.n_strings = (uint32_t)strings.size();
+        for (auto s : strings)
+        {
+            write((uint32_t)s->size());
+            data.insert(data.end(), s->begin(), s->end());
+        }
+        h.index_offset = data.size();
+        h.n_records = (uint32_t)index.size();
+        for (auto o : index)
+            write(o);
+        h.size = data.size();
+        memcpy(data.data(), &h, sizeof(h));
+    }
+
+private:
+    std::unordered_map<String, uint32_t> ids;
+    std::vector<const String *> strings;
+};
+
+struct SavedConfigsCursor
+{
+    const String &data;
+    const std::vector<std::string_view> &strings;
+    uint64_t pos;
+    uint64_t end;
+
+    template <class T>
+    T read()
+    {
+        if (pos + sizeof(T) > end)
+            throw SW_RUNTIME_ERROR("Unexpected end of saved configs record");
+        T v;
+        memcpy(&v, &data[pos], sizeof(T));
+        pos += sizeof(T);
+        return v;
+    }
+
+    std::string_view string()
+    {
+        auto i = read<uint32_t>();
+        if (i >= strings.size())
+            throw SW_RUNTIME_ERROR("Bad string id in saved configs");
+        return strings[i];
+    }
+
+    // same as TargetSetting::mergeFromJson() on empty setting
+    void readValue(TargetSetting &s)
+    {
+        switch (read<uint8_t>())
+        {
+        case ScNull:
+            s.setNull();
+            break;
+        case ScString:
+            s = String(string());
+            break;
+        case ScArray:
+        {
+            TargetSetting::Array a;
+            auto n = read<uint32_t>();
+            a.resize(n);
+            for (auto &v : a)
+                readValue(v);
+            s = a;
+            break;
+        }
+        case ScObject:
+            s = TargetSettings();
+            readObject(s.getMap());
+            break;
+        default:
+            throw SW_RUNTIME_ERROR("Bad value type in saved configs");
+        }
+    }
+
+    // same as TargetSettings::mergeFromJson()
+    void readObject(TargetSettings &ts)
+    {
+        static const String used_in_hash = "_used_in_hash";
+        static const String ignore_in_comparison = "_ignore_in_comparison";
+
+        auto n = read<uint32_t>();
+        while (n--)
+        {
+            String k(string());
+            if (pystring::endswith(k, used_in_hash))
+            {
+                TargetSetting v;
+                readValue(v);
+                if (v == "false")
+                    ts[k.substr(0, k.size() - used_in_hash.size())].useInHash(false);
+                continue;
+            }
+            if (pystring::endswith(k, ignore_in_comparison))
+            {
+                TargetSetting v;
+                readValue(v);
+                if (v == "true")
+                    ts[k.substr(0, k.size() - ignore_in_comparison.size())].ignoreInComparison(true);
+                continue;
+            }
+            readValue(ts[k]);
+        }
+    }
+};
+
+}
+
+static String getRecordKey(std::string_view package, std::string_view config)
+{
+    String k;
+    k.reserve(package.size() + config.size() + 1);
+    k += package;
+    k += ' ';
+    k += config;
+    return k;
+}
+
+SavedConfigs::SavedConfigs(const path &fn)
+{
+    if (!fs::exists(fn))
+        return;
+    try
+    {
+        read(fn);
+    }
+    catch (std::exception &e)
+    {
+        LOG_DEBUG(logger, "Cannot load saved configs snapshot " << to_string(fn) << ", ignoring: " << e.what());
+        data.clear();
+        strings.clear();
+        records.clear();
+    }
+}
+
+void SavedConfigs::read(const path &fn)
+{
+    std::ifstream ifs(fn, std::ios_base::in | std::ios_base::binary);
+    if (!ifs)
+        throw SW_RUNTIME_ERROR("Cannot read file: " + to_string(fn));
+    data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+
+    SavedConfigsHeader h;
+    if (data.size() < sizeof(h))
+        throw SW_RUNTIME_ERROR("File is too small");
+    memcpy(&h, data.data(), sizeof(h));
+    if (memcmp(h.magic, sc_magic, sizeof(sc_magic)) != 0)
+        throw SW_RUNTIME_ERROR("Bad magic");
+    if (h.version != sc_version)
+        throw SW_RUNTIME_ERROR("Unsupported version " + std::to_string(h.version));
+    if (h.size != data.size()
+        || h.strings_offset < sizeof(h) || h.strings_offset > h.index_offset
+        || h.index_offset + h.n_records * sizeof(uint64_t) != h.size)
+        throw SW_RUNTIME_ERROR("Bad sections");
+
+    // strings stay in the buffer
+    strings.reserve(h.n_strings);
+    SavedConfigsCursor c{ data, strings, h.strings_offset, h.index_offset };
+    for (uint32_t i = 0; i < h.n_strings; i++)
+    {
+        auto sz = c.read<uint32_t>();
+        if (c.pos + sz > c.end)
+            throw SW_RUNTIME_ERROR("Bad string table");
+        strings.emplace_back(&data[c.pos], sz);
+        c.pos += sz;
+    }
+
+    // only record headers are read here
+    records.reserve(h.n_records);
+    for (uint32_t i = 0; i < h.n_records; i++)
+    {
+        uint64_t pos;
+        memcpy(&pos, &data[h.index_offset + i * sizeof(pos)], sizeof(pos));
+        if (pos < sizeof(h) || pos >= h.strings_offset)
+            throw SW_RUNTIME_ERROR("Bad record offset");
+        SavedConfigsCursor r{ data, strings, pos, h.strings_offset };
+        auto package = r.string();
+        auto config = r.string();
+        auto hash = r.string();
+        records[getRecordKey(package, config)] = { hash, r.pos };
+    }
+}
+
+std::optional<TargetSettings> SavedConfigs::load(const String &package, const String &config, const String &hash) const
+{
+    auto i = records.find(getRecordKey(package, config));
+    if (i == records.end() || i->second.hash != hash)
+        return {};
+    try
+    {
+        SavedConfigsCursor r{ data, strings, i->second.offset, data.size() };
+        TargetSetting s;
+        r.readValue(s);
+        if (!s.isObject())
+            return TargetSettings{};
+        return s.getMap();
+    }
+    catch (std::exception &e)
+    {
+        LOG_DEBUG(logger, "Cannot load saved config of " << package << ": " << e.what());
+        return {};
+    }
+}
+
+bool SavedConfigs::matches(const std::vector<Entry> &entries) const
+{
+    if (entries.size() != records.size())
+        return false;
+    for (auto &e : entries)
+    {
+        auto i = records.find(getRecordKey(e.package, e.config));
+        if (i == records.end() || i->second.hash != e.hash)
+            return false;
+    }
+    return true;
+}
+
+void SavedConfigs::save(const path &fn, const std::vector<Entry> &entries)
+{
+    SavedConfigsWriter w;
+    for (auto &e : entries)
+        w.writeRecord(e);
+    w.finish();
+
+    // atomic, readers of other builds never see partial files
+    fs::create_directories(fn.parent_path());
+    auto t = path(fn) += ".tmp";
+    {
+        std::ofstream ofs(t, std::ios_base::out | std::ios_base::binary);
+        if (!ofs)
+            throw SW_RUNTIME_ERROR("Cannot open file: " + to_string(t));
+        ofs.write((const char *)w.data.data(), w.data.size());
+        if (!ofs)
+            throw SW_RUNTIME_ERROR("Cannot write file: " + to_string(t));
+    }
+    fs::rename(t, fn);
+}
+
+}
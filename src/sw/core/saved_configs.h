@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include "settings.h"
+
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace sw
+{
+
+/// binary snapshot of interface settings of all saved configs of the build
+/// records are decoded on request, so unused configs cost nothing
+struct SavedConfigs
+{
+    struct Entry
+    {
+        String package;
+        String config; // settings hash
+        String hash; // interface settings hash
+        const TargetSettings *settings;
+    };
+
+    /// missing or broken file gives an empty snapshot
+    SavedConfigs(const path &fn);
+
+    /// nullopt if there is no record or it has another interface settings hash
+    std::optional<TargetSettings> load(const String &package, const String &config, const String &hash) const;
+    /// true if the snapshot has exactly these entries
+    bool matches(const std::vector<Entry> &) const;
+    size_t size() const { return records.size(); }
+
+    static void save(const path &fn, const std::vector<Entry> &);
+
+private:
+    struct Record
+    {
+        std::string_view hash;
+        uint64_t offset; // of the settings
+    };
+
+    String data;
+    std::vector<std::string_view> strings;
+    std::unordered_map<String, Record> records; // package + config -> record
+
+    void read(const path &fn);
+};
+
+}
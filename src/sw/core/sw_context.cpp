@@ -8,6 +8,7 @@
 #include "input_database.h"
 #include "driver.h"
 
+#include <sw/builder/file_storage.h>
 #include <sw/manager/storage.h>
 
 #include <primitives/executor.h>
@@ -89,9 +90,26 @@ SwContext::~SwContext()
 {
 }
 
+void SwContext::setResident(bool r)
+{
+    if (!r)
+        resident_storages.reset();
+    else if (!resident_storages)
+    {
+        resident_storages = std::make_unique<SwBuilderContext>();
+        resident_storages->getFileStorage().startWatcher();
+    }
+}
+
 std::unique_ptr<SwBuild> SwContext::createBuild1()
 {
     auto b = std::make_unique<SwBuild>(*this, fs::current_path() / SW_BINARY_DIR);
+    if (resident_storages)
+    {
+        // files will be checked again lazily
+        resident_storages->getFileStorage().resetChanged();
+        b->setStorageContext(*resident_storages);
+    }
     return b;
 }
 
@@ -15,6 +15,7 @@ struct IDriver;
 struct Input;
 struct InputDatabase;
 struct SwBuild;
+struct SwBuilderContext;
 
 // core context for drivers
 struct SW_CORE_API SwCoreContext : SwManagerContext
@@ -77,10 +78,15 @@ struct SW_CORE_API SwContext : SwCoreContext
     const TargetSettings &getSettings() const { return settings; }
     void setSettings(const TargetSettings &s) { settings = s; }
 
+    /// keep command and file storages in memory between builds
+    void setResident(bool);
+    bool isResident() const { return !!resident_storages; }
+
 private:
     using InputPtr = std::unique_ptr<Input>;
     using Inputs = std::map<size_t, InputPtr>;
 
+    std::unique_ptr<SwBuilderContext> resident_storages; // outlives builds
     Drivers drivers;
     Inputs inputs;
     TargetSettings settings;
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#include "target_graph.h"
+
+#include <primitives/exceptions.h>
+
+namespace sw
+{
+
+static bool isNativeBinary(const TargetSettings &s)
+{
+    if (s["header_only"] == "true")
+        return false;
+    return s["type"] == "native_shared_library" || s["type"] == "native_static_library" || s["type"] == "native_executable";
+}
+
+TargetGraph::TargetGraph(const TargetMap &tm)
+{
+    for (const auto &[pkg, tgts] : tm)
+    {
+        for (auto &tgt : tgts)
+        {
+            if (!ids.emplace(tgt.get(), nodes.size()).second)
+                continue;
+            auto &n = nodes.emplace_back();
+            n.target = tgt;
+        }
+    }
+
+    // every settings lookup is done once here
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        auto &n = nodes[i];
+        const auto &s = n.target->getInterfaceSettings();
+        n.native = isNativeBinary(s);
+        n.shared = s["type"] == "native_shared_library";
+
+        for (auto d : n.target->getDependencies())
+        {
+            if (!d->isResolved())
+                continue;
+            auto j = ids.find(&d->getTarget());
+            if (j == ids.end() || j->second == i)
+                continue;
+            n.dependencies.push_back(j->second);
+            nodes[j->second].dependents.push_back(i);
+        }
+
+        auto add_deps = [this, &tm, &n, i](const auto &in, auto &out, auto &unresolved)
+        {
+            for (auto &[k, v] : in)
+            {
+                auto p = tm.find(PackageId(k));
+                // the graph is built for all targets, report only those which are walked
+                if (p == tm.end())
+                {
+                    unresolved.push_back(k);
+                    n.missing.push_back(k);
+                    continue;
+                }
+                auto j = p->second.findSuitable(v.getMap());
+                if (j == p->second.end())
+                {
+                    unresolved.push_back(k);
+                    continue;
+                }
+                if (auto d = getIndex(**j); d != i)
+                    out.push_back(d);
+            }
+        };
+        add_deps(s["dependencies"]["link"].getMap(), n.link, n.unresolved_link);
+        add_deps(s["dependencies"]["dummy"].getMap(), n.dummy, n.unresolved_dummy);
+    }
+}
+
+size_t TargetGraph::getIndex(const ITarget &t) const
+{
+    auto i = ids.find(&t);
+    if (i == ids.end())
+        throw SW_RUNTIME_ERROR("Target is not in the graph: " + t.getPackage().toString());
+    return i->second;
+}
+
+std::vector<size_t> TargetGraph::getBuildClosure(const std::vector<size_t> &roots) const
+{
+    std::vector<bool> visited(nodes.size());
+    std::vector<size_t> r, q;
+    for (auto i : roots)
+    {
+        if (visited[i])
+            continue;
+        visited[i] = true;
+        r.push_back(i);
+        // some static builds won't build deps, because there's no dependent link files
+        // (e.g. build static png, zlib won't be built)
+        if (nodes[i].native)
+            q.push_back(i);
+    }
+    while (!q.empty())
+    {
+        auto i = q.back();
+        q.pop_back();
+        if (!nodes[i].missing.empty())
+            throw SW_RUNTIME_ERROR("dep not found: " + nodes[i].missing[0]);
+        auto add = [&visited, &r, &q](const auto &deps)
+        {
+            for (auto d : deps)
+            {
+                if (visited[d])
+                    continue;
+                visited[d] = true;
+                r.push_back(d);
+                q.push_back(d);
+            }
+        };
+        add(nodes[i].link);
+        add(nodes[i].dummy);
+    }
+    return r;
+}
+
+}
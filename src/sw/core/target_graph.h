@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include "target.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace sw
+{
+
+/// resolved dependency graph of prepared targets
+/// targets are referred by their index, so walks do no settings lookups
+struct SW_CORE_API TargetGraph
+{
+    struct Node
+    {
+        ITargetPtr target;
+        std::vector<size_t> dependencies; // resolved ITarget::getDependencies()
+        std::vector<size_t> dependents;
+        std::vector<size_t> link; // interface settings "dependencies.link"
+        std::vector<size_t> dummy; // interface settings "dependencies.dummy"
+        // deps without suitable target (probably loaded configs)
+        Strings unresolved_link;
+        Strings unresolved_dummy;
+        // unresolved deps which packages are not loaded at all, walks throw on them
+        Strings missing;
+        bool native = false; // native binary, not header only
+        bool shared = false;
+    };
+
+    TargetGraph(const TargetMap &);
+
+    const std::vector<Node> &getNodes() const { return nodes; }
+    const Node &getNode(size_t i) const { return nodes[i]; }
+    /// throws if target is not in the graph
+    size_t getIndex(const ITarget &) const;
+
+    /// roots and everything they link (transitively), walk goes only from native roots
+    /// throws if a walked target has a dependency on not loaded package
+    std::vector<size_t> getBuildClosure(const std::vector<size_t> &roots) const;
+
+private:
+    std::vector<Node> nodes;
+    std::unordered_map<const ITarget *, size_t> ids;
+};
+
+}
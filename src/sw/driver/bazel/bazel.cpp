@@ -6,11 +6,21 @@
 #include "driver.h"
 
 #include <boost/algorithm/string.hpp>
+#include <primitives/exceptions.h>
 #include <primitives/filesystem.h>
+#include <primitives/hash.h>
 #include <pystring.h>
 
 #include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include <regex>
+#include <thread>
+
+// bump when bazel::File layout or the parser output changes
+#define BAZEL_CACHE_FORMAT_VERSION 1
 
 namespace {
 
@@ -37,6 +47,162 @@ std::string prepare_project_name(const std::string &s)
     return t;
 }
 
+struct Writer
+{
+    std::string data;
+
+    void write(uint32_t v)
+    {
+        data.append((const char *)&v, sizeof(v));
+    }
+
+    void write(const std::string &s)
+    {
+        write((uint32_t)s.size());
+        data += s;
+    }
+
+    void write(const bazel::Parameter &p)
+    {
+        write(p.name);
+        write((uint32_t)p.values.size());
+        for (auto &v : p.values)
+            write(v);
+    }
+
+    void write(const bazel::File &f)
+    {
+        write((uint32_t)f.functions.size());
+        for (auto &fn : f.functions)
+        {
+            write(fn.name);
+            write((uint32_t)fn.parameters.size());
+            for (auto &p : fn.parameters)
+                write(p);
+        }
+        write((uint32_t)f.parameters.size());
+        for (auto &[k, p] : f.parameters)
+        {
+            write(k);
+            write(p);
+        }
+    }
+};
+
+struct Reader
+{
+    const std::string &data;
+    size_t pos = 0;
+
+    Reader(const std::string &data) : data(data) {}
+
+    void check(size_t sz) const
+    {
+        if (pos + sz > data.size())
+            throw SW_RUNTIME_ERROR("Truncated bazel cache file");
+    }
+
+    uint32_t read_int()
+    {
+        uint32_t v;
+        check(sizeof(v));
+        memcpy(&v, &data[pos], sizeof(v));
+        pos += sizeof(v);
+        return v;
+    }
+
+    std::string read_string()
+    {
+        auto sz = read_int();
+        check(sz);
+        auto s = data.substr(pos, sz);
+        pos += sz;
+        return s;
+    }
+
+    bazel::Parameter read_parameter()
+    {
+        bazel::Parameter p;
+        p.name = read_string();
+        auto n = read_int();
+        while (n--)
+            p.values.insert(read_string());
+        return p;
+    }
+
+    bazel::File read_bazel_file()
+    {
+        bazel::File f;
+        auto n = read_int();
+        f.functions.reserve(n);
+        while (n--)
+        {
+            bazel::Function fn;
+            fn.name = read_string();
+            auto np = read_int();
+            fn.parameters.reserve(np);
+            while (np--)
+                fn.parameters.push_back(read_parameter());
+            f.functions.push_back(std::move(fn));
+        }
+        n = read_int();
+        while (n--)
+        {
+            auto k = read_string();
+            f.parameters[k] = read_parameter();
+        }
+        if (pos != data.size())
+            throw SW_RUNTIME_ERROR("Bad bazel cache file");
+        return f;
+    }
+};
+
+std::string getCacheHeader()
+{
+    return "swbazel" + std::to_string(BAZEL_CACHE_FORMAT_VERSION);
+}
+
+bool loadCached(const path &fn, bazel::File &f)
+{
+    if (!fs::exists(fn))
+        return false;
+    try
+    {
+        auto s = read_file(fn);
+        auto hdr = getCacheHeader();
+        if (s.compare(0, hdr.size(), hdr) != 0)
+            return false;
+        s = s.substr(hdr.size());
+        f = Reader(s).read_bazel_file();
+        return true;
+    }
+    catch (std::exception &)
+    {
+        std::error_code ec;
+        fs::remove(fn, ec);
+    }
+    return false;
+}
+
+void saveCached(const path &fn, const bazel::File &f)
+{
+    Writer w;
+    w.data = getCacheHeader();
+    w.write(f);
+    try
+    {
+        // write into temp file and rename, so parallel processes never see partial file
+        fs::create_directories(fn.parent_path());
+        auto tmp = path(fn) += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        write_file(tmp, w.data);
+        fs::rename(tmp, fn);
+    }
+    catch (std::exception &)
+    {
+        // cache is optional
+    }
+}
+
 }
 
 namespace bazel
@@ -143,4 +309,38 @@ File parse(const std::string &s)
     return pd.bazel_file;
 }
 
+const File &parse(const std::string &s, const path &cache_dir)
+{
+    struct Entry
+    {
+        std::once_flag once;
+        File f;
+    };
+
+    static std::mutex m;
+    static std::unordered_map<std::string, std::shared_ptr<Entry>> files;
+
+    auto h = shorten_hash(blake2b_512(s), 32);
+    std::shared_ptr<Entry> e;
+    {
+        std::unique_lock lk(m);
+        auto &p = files[h];
+        if (!p)
+            p = std::make_shared<Entry>();
+        e = p;
+    }
+
+    // other threads asking for the same file wait here until it is ready
+    std::call_once(e->once, [&s, &h, &cache_dir, &e]()
+    {
+        auto fn = cache_dir.empty() ? path{} : cache_dir / h.substr(0, 2) / (h + ".bin");
+        if (!fn.empty() && loadCached(fn, e->f))
+            return;
+        e->f = parse(s);
+        if (!fn.empty())
+            saveCached(fn, e->f);
+    });
+    return e->f;
+}
+
 } // namespace bazel
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <filesystem>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -46,4 +47,10 @@ struct File
 
 File parse(const std::string &s);
 
+/// Parse with a cache keyed by the content hash.
+/// Results are shared between all callers in the process and
+/// are also stored in compact binary form in cache_dir (if not empty).
+/// Safe to call from multiple threads.
+const File &parse(const std::string &s, const std::filesystem::path &cache_dir);
+
 } // namespace bazel
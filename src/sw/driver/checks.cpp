@@ -9,6 +9,7 @@
 #include "target/native.h"
 
 #include <sw/builder/execution_plan.h>
+#include <sw/builder/time_trace.h>
 #include <sw/core/sw_context.h>
 #include <sw/manager/storage.h>
 #include <sw/support/filesystem.h>
@@ -271,6 +272,8 @@ void CheckSet::performChecks(const SwBuild &mb, const TargetSettings &ts)
     if (!t)
         throw SW_RUNTIME_ERROR("Target was not set");
 
+    TimeTrace::Scope tts("checks " + t->getPackage().toString(), "checks");
+
     auto config = ts.getHash();
     auto fn = checks_dir / config / "checks.3.txt";
     auto &cs = getChecksStorage(config, fn);
@@ -19,6 +19,7 @@
 #include "compiler/detect.h"
 #include "compiler/set_settings.h"
 
+#include <sw/builder/time_trace.h>
 #include <sw/core/input.h>
 #include <sw/core/specification.h>
 #include <sw/core/sw_context.h>
@@ -591,6 +592,8 @@ TargetSettings Driver::getDllConfigSettings(SwContext &swctx) const
 // not thread-safe
 std::unordered_map<path, PrepareConfigOutputData> Driver::build_configs1(SwContext &swctx, const std::set<Input *> &inputs) const
 {
+    TimeTrace::Scope ts("build configs", "configure");
+
     auto cfg_storage_dir = swctx.getLocalStorage().storage_dir_tmp / "cfg" / "stamps";
     fs::create_directories(cfg_storage_dir);
 
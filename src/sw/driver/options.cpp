@@ -9,11 +9,188 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <bitset>
 #include <tuple>
 
 namespace sw
 {
 
+// Compiled form of simple regexes used in file globs.
+// Most of the patterns are like '.*\.cpp', 'src/.*' or '[^\.].*',
+// so we match them with a wildcard matcher instead of std::regex.
+struct FileRegexMatcher
+{
+    enum Kind
+    {
+        Char,
+        AnyChar,
+        AnyString,
+        CharClass,
+    };
+
+    struct Token
+    {
+        Kind kind = Char;
+        char c = 0;
+        std::bitset<256> cls;
+
+        bool match(char in) const
+        {
+            switch (kind)
+            {
+            case Char:
+                return in == c;
+            case AnyChar:
+                return in != '\n' && in != '\r';
+            case CharClass:
+                return cls[(unsigned char)in];
+            default:
+                return false;
+            }
+        }
+    };
+
+    std::vector<Token> tokens;
+
+    // returns nullptr if pattern cannot be handled here
+    static std::shared_ptr<const FileRegexMatcher> compile(const String &s)
+    {
+        auto m = std::make_shared<FileRegexMatcher>();
+        auto is_escapable = [](char c)
+        {
+            // \d, \w etc. are classes, leave them to std::regex
+            return !isalnum((unsigned char)c);
+        };
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            Token t;
+            switch (s[i])
+            {
+            case '\\':
+                if (i + 1 == s.size() || !is_escapable(s[i + 1]))
+                    return {};
+                t.kind = Char;
+                t.c = s[++i];
+                break;
+            case '.':
+                if (i + 1 < s.size() && s[i + 1] == '*')
+                {
+                    t.kind = AnyString;
+                    i++;
+                }
+                else if (i + 1 < s.size() && s[i + 1] == '+')
+                {
+                    t.kind = AnyChar;
+                    m->tokens.push_back(t);
+                    t.kind = AnyString;
+                    i++;
+                }
+                else
+                    t.kind = AnyChar;
+                break;
+            case '[':
+            {
+                t.kind = CharClass;
+                bool negate = false;
+                if (++i < s.size() && s[i] == '^')
+                {
+                    negate = true;
+                    i++;
+                }
+                if (i < s.size() && s[i] == ']')
+                    return {};
+                bool closed = false;
+                for (; i < s.size(); i++)
+                {
+                    if (s[i] == ']')
+                    {
+                        closed = true;
+                        break;
+                    }
+                    if (s[i] == '[')
+                        return {}; // [:alpha:] etc.
+                    char from = s[i];
+                    if (from == '\\')
+                    {
+                        if (i + 1 == s.size() || !is_escapable(s[i + 1]))
+                            return {};
+                        from = s[++i];
+                    }
+                    char to = from;
+                    if (i + 2 < s.size() && s[i + 1] == '-' && s[i + 2] != ']')
+                    {
+                        to = s[i + 2];
+                        if (to == '\\')
+                            return {};
+                        i += 2;
+                    }
+                    if ((unsigned char)from > (unsigned char)to)
+                        return {};
+                    for (int c = (unsigned char)from; c <= (unsigned char)to; c++)
+                        t.cls.set(c);
+                }
+                if (!closed)
+                    return {};
+                if (negate)
+                    t.cls.flip();
+                break;
+            }
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+            case '}':
+            case '(':
+            case ')':
+            case '|':
+            case '^':
+            case '$':
+            case ']':
+                return {};
+            default:
+                t.kind = Char;
+                t.c = s[i];
+                break;
+            }
+            // quantifier after a non-dot token
+            if (t.kind != AnyString && i + 1 < s.size() && (s[i + 1] == '*' || s[i + 1] == '+' || s[i + 1] == '?' || s[i + 1] == '{'))
+                return {};
+            m->tokens.push_back(t);
+        }
+        return m;
+    }
+
+    bool match(const String &s) const
+    {
+        size_t p = 0, i = 0;
+        size_t star = -1, mark = 0;
+        while (i < s.size())
+        {
+            if (p < tokens.size() && tokens[p].kind == AnyString)
+            {
+                star = p++;
+                mark = i;
+            }
+            else if (p < tokens.size() && tokens[p].match(s[i]))
+            {
+                p++;
+                i++;
+            }
+            else if (star != -1 && s[mark] != '\n' && s[mark] != '\r')
+            {
+                // let the last '.*' consume one more char
+                p = star + 1;
+                i = ++mark;
+            }
+            else
+                return false;
+        }
+        while (p < tokens.size() && tokens[p].kind == AnyString)
+            p++;
+        return p == tokens.size();
+    }
+};
+
 ApiNameType::ApiNameType(const String &s)
 {
     a = s;
@@ -106,8 +283,7 @@ FileRegex::FileRegex(const String &fn, bool recursive)
         p = fn.find_first_of("/*?+[.\\", p);
         if (p == -1 || fn[p] != '/')
         {
-            regex_string = fn.substr(p0);
-            r = regex_string;
+            setRegex(fn.substr(p0));
             return;
         }
 
@@ -125,8 +301,7 @@ FileRegex::FileRegex(const String &fn, bool recursive)
 
         if (s.find_first_of("*?+.[](){}") != -1)
         {
-            regex_string = fn.substr(p0);
-            r = regex_string;
+            setRegex(fn.substr(p0));
             return;
         }
 
@@ -158,6 +333,20 @@ String FileRegex::getRegexString() const
     return to_string(normalize_path(dir / "")) + regex_string;
 }
 
+void FileRegex::setRegex(const String &s)
+{
+    regex_string = s;
+    r = regex_string;
+    matcher = FileRegexMatcher::compile(regex_string);
+}
+
+bool FileRegex::match(const String &s) const
+{
+    if (matcher)
+        return matcher->match(s);
+    return std::regex_match(s, r);
+}
+
 template <class C>
 void unique_merge_containers(C &to, const C &from)
 {
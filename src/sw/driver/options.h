@@ -211,6 +211,8 @@ struct SW_DRIVER_CPP_API PrecompiledHeader
     explicit PrecompiledHeader(const path &p);
 };
 
+struct FileRegexMatcher;
+
 struct SW_DRIVER_CPP_API FileRegex
 {
     path dir;
@@ -224,8 +226,16 @@ struct SW_DRIVER_CPP_API FileRegex
 
     String getRegexString() const;
 
+    /// Match relative path against regex.
+    /// Simple patterns (literals, '.', '.*', char classes) are matched
+    /// without std::regex.
+    bool match(const String &s) const;
+
 private:
     String regex_string;
+    std::shared_ptr<const FileRegexMatcher> matcher;
+
+    void setRegex(const String &s);
 };
 
 using DependenciesType = UniqueVector<DependencyPtr>;
@@ -10,10 +10,14 @@
 #include "compiler/rc.h"
 #include "target/native.h"
 
+#include <sw/builder/command_storage.h>
 #include <sw/builder/jumppad.h>
 
+#include <boost/algorithm/string.hpp>
 #include <primitives/exceptions.h>
 
+#include <thread>
+
 void createDefFile(const path &def, const Files &obj_files)
 #if defined(CPPAN_OS_WINDOWS)
 ;
@@ -283,6 +287,229 @@ void NativeCompilerRule::setup(const Target &t)
     }
 }
 
+struct UnityFile
+{
+    path file;
+    String name; // normalized
+    double cost = 0;
+    int batch = -1;
+};
+
+// fallback when we have no timings: size of the file plus fixed price for every include
+static double estimateUnityFileCost(const path &p)
+{
+    static const double include_cost = 4096; // in bytes of source
+
+    double cost = 0;
+    error_code ec;
+    auto sz = fs::file_size(p, ec);
+    if (!ec)
+        cost += sz;
+    try
+    {
+        std::istringstream ss(read_file(p));
+        String line;
+        while (std::getline(ss, line))
+        {
+            auto pos = line.find_first_not_of(" \t");
+            if (pos != line.npos && line.compare(pos, 8, "#include") == 0)
+                cost += include_cost;
+        }
+    }
+    catch (std::exception &)
+    {
+    }
+    return std::max(cost, 1.0);
+}
+
+static String getUnityFilename(int batch, const String &ext)
+{
+    return "Module." + std::to_string(batch + 1) + ext;
+}
+
+// previous batches from already written unity files
+static std::map<int, std::vector<String>> readUnityBatches(const path &dir, const String &ext)
+{
+    std::map<int, std::vector<String>> batches;
+    if (!fs::exists(dir))
+        return batches;
+    static const String include = "#include \"";
+    for (auto &e : fs::directory_iterator(dir))
+    {
+        auto fn = to_string(e.path().filename().u8string());
+        if (fn.find("Module.") != 0 || e.path().extension().string() != ext)
+            continue;
+        int idx;
+        try
+        {
+            idx = std::stoi(fn.substr(7)) - 1;
+        }
+        catch (std::exception &)
+        {
+            continue;
+        }
+        auto &b = batches[idx];
+        for (auto &l : split_lines(read_file(e.path())))
+        {
+            if (l.find(include) == 0 && l.back() == '"')
+                b.push_back(l.substr(include.size(), l.size() - include.size() - 1));
+        }
+    }
+    return batches;
+}
+
+// longest processing time first
+static void assignUnityBatchesLpt(std::vector<UnityFile *> &files, std::vector<double> &loads)
+{
+    std::stable_sort(files.begin(), files.end(), [](auto f1, auto f2)
+    {
+        return f1->cost > f2->cost;
+    });
+    for (auto f : files)
+    {
+        auto i = std::min_element(loads.begin(), loads.end()) - loads.begin();
+        f->batch = (int)i;
+        loads[i] += f->cost;
+    }
+}
+
+// Balances unity batches by estimated compile cost.
+// Files keep their previous batches when possible, so editing sources
+// does not move other files around and rebuild all batches.
+// Full rebalance happens only when it gives significantly better result.
+static Files createUnityFiles(const NativeCompiledTarget &t, std::vector<UnityFile> &files, const String &ext)
+{
+    Files out;
+    auto dir = t.BinaryPrivateDir / "unity";
+    auto prev_batches = readUnityBatches(dir, ext);
+
+    if (!files.empty())
+    {
+        int nbatches;
+        if (t.UnityBuildBatchSize > 0)
+            nbatches = (int)(files.size() + t.UnityBuildBatchSize - 1) / t.UnityBuildBatchSize;
+        else
+        {
+            int jobs = std::thread::hardware_concurrency();
+            auto &bs = t.getMainBuild().getSettings();
+            if (bs["build-jobs"])
+                jobs = std::stoi(bs["build-jobs"].getValue());
+            nbatches = std::min<int>(files.size(), std::max(jobs, 1));
+        }
+
+        // costs
+        std::unordered_map<String, double> fallback;
+        for (auto &f : files)
+            fallback[f.name] = estimateUnityFileCost(f.file);
+
+        std::unordered_map<String, double> known; // ms
+        if (auto cs = t.getCommandStorage())
+        {
+            for (auto &f : files)
+            {
+                if (auto tm = cs->getInputTiming(f.file))
+                    known[f.name] = (double)tm->count();
+            }
+            // split batch time between its files
+            for (auto &[i, names] : prev_batches)
+            {
+                auto tm = cs->getInputTiming(dir / getUnityFilename(i, ext));
+                if (!tm)
+                    continue;
+                double sum = 0;
+                for (auto &n : names)
+                {
+                    if (auto j = fallback.find(n); j != fallback.end())
+                        sum += j->second;
+                }
+                for (auto &n : names)
+                {
+                    if (auto j = fallback.find(n); j != fallback.end())
+                        known[n] = tm->count() * j->second / sum;
+                }
+            }
+        }
+        double known_ms = 0, known_fallback = 0;
+        for (auto &[n, ms] : known)
+        {
+            known_ms += ms;
+            known_fallback += fallback[n];
+        }
+        auto ratio = known_fallback > 0 ? known_ms / known_fallback : 1.0;
+        for (auto &f : files)
+        {
+            if (auto i = known.find(f.name); i != known.end())
+                f.cost = std::max(i->second, 1.0);
+            else
+                f.cost = fallback[f.name] * ratio;
+        }
+
+        // keep previous membership
+        std::unordered_map<String, int> prev;
+        for (auto &[i, names] : prev_batches)
+        {
+            for (auto &n : names)
+                prev[n] = i;
+        }
+        std::vector<double> loads(nbatches);
+        std::vector<UnityFile *> unassigned, all;
+        for (auto &f : files)
+        {
+            all.push_back(&f);
+            auto i = prev.find(f.name);
+            if (i != prev.end() && i->second < nbatches)
+            {
+                f.batch = i->second;
+                loads[f.batch] += f.cost;
+            }
+            else
+                unassigned.push_back(&f);
+        }
+        assignUnityBatchesLpt(unassigned, loads);
+
+        // try from scratch
+        std::vector<int> saved;
+        for (auto f : all)
+            saved.push_back(f->batch);
+        std::vector<double> lpt_loads(nbatches);
+        auto lpt = all;
+        assignUnityBatchesLpt(lpt, lpt_loads);
+        auto max_current = *std::max_element(loads.begin(), loads.end());
+        auto max_lpt = *std::max_element(lpt_loads.begin(), lpt_loads.end());
+        // only 20% gain is worth moving files around
+        if (max_lpt * 1.2 >= max_current)
+        {
+            for (size_t i = 0; i < all.size(); i++)
+                all[i]->batch = saved[i];
+        }
+
+        // write
+        std::vector<String> contents(nbatches);
+        for (auto &f : files)
+            contents[f.batch] += "#include \"" + f.name + "\"\n";
+        for (int i = 0; i < nbatches; i++)
+        {
+            if (contents[i].empty())
+                continue;
+            auto fn = dir / getUnityFilename(i, ext);
+            write_file_if_different(fn, contents[i]); // do not trigger rebuilds
+            out.insert(fn);
+        }
+    }
+
+    // remove stale batches
+    for (auto &[i, _] : prev_batches)
+    {
+        auto fn = dir / getUnityFilename(i, ext);
+        if (!out.contains(fn))
+        {
+            error_code ec;
+            fs::remove(fn, ec);
+        }
+    }
+    return out;
+}
+
 void NativeCompilerRule::addInputs(const Target &t, RuleFiles &rfs)
 {
     auto &cl = static_cast<NativeCompiler &>(*program);
@@ -304,35 +531,7 @@ void NativeCompilerRule::addInputs(const Target &t, RuleFiles &rfs)
     // unity build
     if (nt && nt->UnityBuild)
     {
-        /*std::vector<NativeSourceFile *> files2(files.begin(), files.end());
-        std::sort(files2.begin(), files2.end(), [](const auto f1, const auto f2)
-        {
-            return f1->index < f2->index;
-        });*/
-
-        struct data
-        {
-            String s;
-            int idx = 0;
-            String ext;
-        };
-
-        data c, cpp;
-        c.ext = ".c";
-        cpp.ext = ".cpp";
-        int fidx = 1; // for humans
-        auto writef = [nt, &fidx, &rfs_unity](auto &d)
-        {
-            if (d.s.empty())
-                return;
-            auto fns = "Module." + std::to_string(fidx++) + d.ext;
-            auto fn = nt->BinaryPrivateDir / "unity" / fns;
-            write_file_if_different(fn, d.s); // do not trigger rebuilds
-            //getMergeObject()[fn].fancy_name = "[" + getPackage().toString() + "]/[unity]/" + fns;
-            d.s.clear();
-            rfs_unity.addFile(fn);
-        };
-
+        std::vector<UnityFile> c, cpp;
         for (auto &[n,rf] : rfs)
         {
             // skip when args are populated
@@ -353,13 +552,13 @@ void NativeCompilerRule::addInputs(const Target &t, RuleFiles &rfs)
                 continue;
 
             // asm won't work here right now
-            data &d = cext ? c : cpp;
-            d.s += "#include \"" + to_string(normalize_path(rf.getFile())) + "\"\n";
-            if (++d.idx % nt->UnityBuildBatchSize == 0)
-                writef(d);
+            auto &v = cext ? c : cpp;
+            v.push_back({ rf.getFile(), to_string(normalize_path(rf.getFile())) });
         }
-        writef(c);
-        writef(cpp);
+        for (auto &fn : createUnityFiles(*nt, c, ".c"))
+            rfs_unity.addFile(fn);
+        for (auto &fn : createUnityFiles(*nt, cpp, ".cpp"))
+            rfs_unity.addFile(fn);
     }
 
     // main loop
@@ -496,6 +695,7 @@ void NativeCompilerRule::addInputs(const Target &t, RuleFiles &rfs)
         if (!rulename.empty())
             nc.getCommand()->name += " ";*/
         nc.getCommand()->name += "[" + t.getPackage().toString() + "]" + tfns.getName(rf.getFile());
+        nc.getCommand()->timing_input = rf.getFile();
         auto &rf = rfs.addFile(output);
         rf.setCommand(c->getCommand());
         rf.addDependency(fn);
@@ -659,9 +859,8 @@ void NativeLinkerRule::addInputs(const Target &t, RuleFiles &rfs)
                     objs.insert(f);
             }
             auto c = std::make_shared<builder::BuiltinCommand>(t.getMainBuild(), SW_VISIBLE_BUILTIN_FUNCTION(create_def_file));
-            c->push_back(deffn);
+            c->setFunction(create_def_file, deffn, objs);
             c->addOutput(deffn);
-            c->push_back(objs);
             c->addInput(objs);
             def = deffn;
             //command_lib = c;
@@ -712,6 +911,27 @@ void NativeLinkerRule::addInputs(const Target &t, RuleFiles &rfs)
         //return;
     //used_files.insert(nc.getOutputFile());
     c->getCommand()->prepare(); // why?
+    if (is_linker)
+    {
+        // defaults until real memory usage is known from previous runs
+        auto &cmd = *c->getCommand();
+        bool lto = std::any_of(cmd.arguments.begin(), cmd.arguments.end(), [](const auto &a)
+        {
+            auto s = a->toString();
+            return s.find("-flto") == 0 || boost::iequals(s, "/LTCG") || boost::iequals(s, "-LTCG");
+        });
+        int n = std::thread::hardware_concurrency();
+        if (lto)
+        {
+            cmd.memory = 4ULL << 30;
+            cmd.pool = getResourcePool("lto", std::max(n / 4, 1));
+        }
+        else
+        {
+            cmd.memory = 1ULL << 30;
+            cmd.pool = getResourcePool("link", std::max(n / 2, 1));
+        }
+    }
     c->getCommand()->name = //(is_linker ? "[LINK]"s : "[LIB]"s) + " " +
         "[" + t.getPackage().toString() + "]" + nt->getOutputFile().extension().string();
     //nt->registerCommand(*c->getCommand());
@@ -10,10 +10,21 @@
 #include <primitives/log.h>
 DECLARE_STATIC_LOGGER(logger, "source_file");
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 // we can do global cache:
 // [sourcedir][f] = files
 // file_cache
-// glob_cache
 
 namespace sw
 {
@@ -29,9 +40,11 @@ static bool IsWindows7OrLater() {
         &version_info, VER_MAJORVERSION | VER_MINORVERSION, comparison);
 }
 
-static Files enumerate_files1(const path &dir, bool recursive = true)
+static void enumerate_files1(const path &dir, bool recursive, DirectoryListing &l)
 {
-    Files files;
+    error_code ec;
+    l.dirs.emplace_back(dir, fs::last_write_time(dir, ec));
+
     // FindExInfoBasic is 30% faster than FindExInfoStandard.
     static bool can_use_basic_info = IsWindows7OrLater();
     // This is not in earlier SDKs.
@@ -47,8 +60,8 @@ static Files enumerate_files1(const path &dir, bool recursive = true)
     {
         DWORD win_err = GetLastError();
         if (win_err == ERROR_FILE_NOT_FOUND || win_err == ERROR_PATH_NOT_FOUND)
-            return files;
-        return files;
+            return;
+        return;
     }
     do
     {
@@ -60,27 +73,153 @@ static Files enumerate_files1(const path &dir, bool recursive = true)
         if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
         {
             if (recursive)
-            {
-                auto f2 = enumerate_files1(dir / ffd.cFileName, recursive);
-                files.insert(f2.begin(), f2.end());
-            }
+                enumerate_files1(dir / ffd.cFileName, recursive, l);
         }
         else
-            files.insert(dir / ffd.cFileName);
+            l.add(dir / ffd.cFileName);
     } while (FindNextFile(find_handle, &ffd));
     FindClose(find_handle);
-    return files;
 }
-#endif
+#else
+// lists single directory, readdir() is getdents64() on linux
+// and d_type saves us a stat() call for almost every entry
+static void enumerate_directory(const path &dir, DirectoryListing &l, std::vector<path> &subdirs)
+{
+    error_code ec;
+    l.dirs.emplace_back(dir, fs::last_write_time(dir, ec));
 
-static Files enumerate_files_fast(const path &dir, bool recursive = true)
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return;
+    auto d = fdopendir(fd);
+    if (!d)
+    {
+        close(fd);
+        return;
+    }
+    while (auto e = readdir(d))
+    {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            continue;
+        auto type = e->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK)
+        {
+            // follow links to files, but never recurse into linked dirs
+            struct stat st;
+            if (fstatat(fd, e->d_name, &st, 0) != 0)
+                continue;
+            if (S_ISREG(st.st_mode))
+                type = DT_REG;
+            else if (S_ISDIR(st.st_mode) && type == DT_UNKNOWN)
+                type = DT_DIR;
+            else
+                continue;
+        }
+        if (type == DT_DIR)
+            subdirs.push_back(dir / e->d_name);
+        else if (type == DT_REG)
+            l.add(dir / e->d_name);
+    }
+    closedir(d);
+}
+
+static void enumerate_files1(const path &dir, bool recursive, DirectoryListing &l)
 {
-    return
-#ifdef _WIN32
-        enumerate_files1(dir, recursive);
-#else
-        enumerate_files(dir, recursive);
+    std::vector<path> subdirs;
+    enumerate_directory(dir, l, subdirs);
+    if (!recursive || subdirs.empty())
+        return;
+
+    // walk the rest of the tree in parallel
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<path> q(subdirs.begin(), subdirs.end());
+    size_t active = 0;
+
+    auto worker = [&]()
+    {
+        DirectoryListing local;
+        std::vector<path> sub;
+        while (1)
+        {
+            path d;
+            {
+                std::unique_lock lk(m);
+                cv.wait(lk, [&]() { return !q.empty() || active == 0; });
+                if (q.empty())
+                    break;
+                d = std::move(q.front());
+                q.pop_front();
+                active++;
+            }
+            sub.clear();
+            enumerate_directory(d, local, sub);
+            {
+                std::unique_lock lk(m);
+                q.insert(q.end(), sub.begin(), sub.end());
+                active--;
+            }
+            cv.notify_all();
+        }
+
+        std::unique_lock lk(m);
+        l.files.insert(l.files.end(), local.files.begin(), local.files.end());
+        l.dirs.insert(l.dirs.end(), local.dirs.begin(), local.dirs.end());
+    };
+
+    auto n = std::min<size_t>({ std::thread::hardware_concurrency(), 8, subdirs.size() });
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < n; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads)
+        t.join();
+}
 #endif
+
+void DirectoryListing::add(const path &p)
+{
+    files.emplace_back(p, to_string(normalize_path(p)));
+}
+
+bool DirectoryListing::isOutdated() const
+{
+    for (auto &[d, t] : dirs)
+    {
+        error_code ec;
+        if (fs::last_write_time(d, ec) != t)
+            return true;
+    }
+    return false;
+}
+
+// listings are shared between all targets,
+// so the same source tree is read only once per build
+static std::shared_ptr<const DirectoryListing> enumerate_files_fast(const path &dir, bool recursive = true)
+{
+    struct Entry
+    {
+        std::mutex m;
+        std::shared_ptr<const DirectoryListing> l;
+    };
+
+    static std::mutex m;
+    static std::unordered_map<path, std::map<bool /* recursive */, Entry>> cache;
+
+    Entry *e;
+    {
+        std::unique_lock lk(m);
+        e = &cache[dir][recursive];
+    }
+
+    std::unique_lock lk(e->m);
+    if (!e->l || e->l->isOutdated())
+    {
+        auto l = std::make_shared<DirectoryListing>();
+        enumerate_files1(dir, recursive, *l);
+        e->l = l;
+    }
+    return e->l;
 }
 
 SourceFileStorage::SourceFileStorage(Target &t)
@@ -276,19 +415,18 @@ void SourceFileStorage::op(const FileRegex &r, Op func)
     if (root_s.back() == '/')
         root_s.resize(root_s.size() - 1);
     auto &files = glob_cache[dir][r.recursive];
-    if (files.empty())
+    if (!files)
         files = enumerate_files_fast(dir, r.recursive);
 
     bool matches = false;
-    for (auto &f : files)
+    for (auto &[f, fstr] : files->files)
     {
-        auto s = to_string(normalize_path(f));
-        if (s.size() < root_s.size() + 1)
+        if (fstr.size() < root_s.size() + 1)
             continue; // file is in bdir or somthing like that
-        if (s.find(root_s) != 0)
+        if (fstr.compare(0, root_s.size(), root_s) != 0)
             continue;
-        s = s.substr(root_s.size() + 1); // + 1 to skip first slash
-        if (std::regex_match(s, r.r))
+        auto s = fstr.substr(root_s.size() + 1); // + 1 to skip first slash
+        if (r.match(s))
         {
             (this->*func)(f);
             matches = true;
@@ -448,7 +586,7 @@ SourceFileStorage::enumerate_files(const FileRegex &r, bool allow_empty) const
         if (s.find(root_s) != 0)
             continue;
         s = s.substr(root_s.size() + 1); // + 1 to skip first slash
-        if (std::regex_match(s, r.r))
+        if (r.match(s))
             files[p] = f;
     }
     if (!target.DryRun) // special case
@@ -20,6 +20,18 @@ struct Target;
 template <class T>
 using SourceFileMap = std::unordered_map<path, std::shared_ptr<T>>;
 
+/// Result of directory enumeration shared between targets.
+struct DirectoryListing
+{
+    /// file and its normalized string
+    std::vector<std::pair<path, String>> files;
+    /// enumerated dirs with their mtimes, used to check if listing is still valid
+    std::vector<std::pair<path, fs::file_time_type>> dirs;
+
+    void add(const path &);
+    bool isOutdated() const;
+};
+
 /**
  * \brief Keeps target files.
  *
@@ -43,7 +55,7 @@ private:
 public:
     // internal, move to target map?
     // but we have two parts: stable for sdir files and unknown for bdir files (config specific)
-    mutable std::unordered_map<path, std::map<bool /* recursive */, Files>> glob_cache;
+    mutable std::unordered_map<path, std::map<bool /* recursive */, std::shared_ptr<const DirectoryListing>>> glob_cache;
     mutable FilesMap files_cache;
 
 public:
@@ -10,4 +10,17 @@
 // 27: change OS::Version field to optional<>
 // 28: Program::clone() result shared -> unique ptr
 // 29: remove virtual method from core.target
-#define SW_MODULE_ABI_VERSION 29
+// 30: FileRegex matcher, shared glob cache
+// 31: add NativeCompiledTarget::AutoPrecompiledHeader
+// 32: typed builtin commands, Command::lightweight
+// 33: weighted ResourcePool, Command memory estimates
+// 34: Command::usage
+// 35: SwBuilderContext storage context (resident daemon)
+// 36: SwBuilderContext remote executor
+// 37: named ResourcePool
+// 38: Command::timeout
+// 39: SwBuild saved configs snapshot
+// 40: SwBuild target graph
+// 41: Command::timing_input
+// 42: ResourceUsage::approximate
+#define SW_MODULE_ABI_VERSION 42
@@ -34,14 +34,7 @@ DECLARE_STATIC_LOGGER(logger, "target.native");
 #define RETURN_PREPARE_MULTIPASS_NEXT_PASS SW_RETURN_MULTIPASS_NEXT_PASS(prepare_pass)
 #define RETURN_INIT_MULTIPASS_NEXT_PASS SW_RETURN_MULTIPASS_NEXT_PASS(init_pass)
 
-static int copy_file(path in, path out)
-{
-    error_code ec;
-    fs::create_directories(out.parent_path());
-    fs::copy_file(in, out, fs::copy_options::overwrite_existing, ec);
-    return !!ec;
-}
-SW_DEFINE_VISIBLE_FUNCTION_JUMPPAD(sw_copy_file, copy_file)
+SW_DEFINE_VISIBLE_FUNCTION_JUMPPAD(sw_copy_file, ::sw::builder::copyFile)
 
 static int remove_file(path f)
 {
@@ -785,12 +778,159 @@ bool NativeCompiledTarget::hasSourceFiles() const
     return r;
 }
 
+// leading includes of a source file
+// scan stops at anything else (defines, conditionals, code),
+// because it may change meaning of the following headers (NOMINMAX before <windows.h>)
+static Strings scanIncludes(const path &fn)
+{
+    Strings includes;
+    String s;
+    try
+    {
+        s = read_file(fn);
+    }
+    catch (std::exception &)
+    {
+        return includes;
+    }
+    bool comment = false;
+    for (auto &l : split_lines(s))
+    {
+        auto p = l.find_first_not_of(" \t\r");
+        if (p == l.npos)
+            continue;
+        if (comment || l.compare(p, 2, "/*") == 0)
+        {
+            auto e = l.find("*/", comment ? p : p + 2);
+            comment = e == l.npos;
+            if (comment || l.find_first_not_of(" \t\r", e + 2) == l.npos)
+                continue;
+            break;
+        }
+        if (l.compare(p, 2, "//") == 0)
+            continue;
+        if (l[p] != '#')
+            break;
+        p = l.find_first_not_of(" \t", p + 1);
+        if (p == l.npos)
+            continue;
+        auto d = l.substr(p);
+        if (d.find("pragma") == 0 && d.find("once") != d.npos)
+            continue;
+        if (d.find("include") != 0)
+            break;
+        auto b = d.find_first_of("<\"", 7);
+        if (b == d.npos)
+            break;
+        auto e = d.find(d[b] == '<' ? '>' : '"', b + 1);
+        if (e == d.npos)
+            break;
+        includes.push_back(d.substr(b, e - b + 1));
+    }
+    return includes;
+}
+
+void NativeCompiledTarget::detectPrecompiledHeader()
+{
+    // thresholds of translation units including a header
+    static const double select_threshold = 0.5;
+    // hysteresis, so small changes in sources do not trigger pch rebuilds
+    static const double keep_threshold = 0.3;
+    static const double add_threshold = 0.7;
+    // pch does not pay off for small targets
+    static const size_t min_tus = 4;
+
+    std::vector<path> tus;
+    for (auto &[p, f] : getMergeObject())
+    {
+        if (!f->isActive())
+            continue;
+        auto ext = p.extension().string();
+        // pch is c++ only and goes into force includes of all files
+        if (ext == ".c")
+            return;
+        if (getCppSourceFileExtensions().contains(ext))
+            tus.push_back(p);
+    }
+    if (tus.size() < min_tus)
+        return;
+    std::sort(tus.begin(), tus.end());
+
+    auto idirs = getMergeObject().gatherIncludeDirectories();
+    auto is_own_header = [this, &idirs](const String &h)
+    {
+        // quoted includes are usually own headers that change often
+        if (h[0] == '"')
+            return true;
+        auto name = h.substr(1, h.size() - 2);
+        for (auto &d : idirs)
+        {
+            if ((is_under_root_by_prefix_path(d, SourceDir) || is_under_root_by_prefix_path(d, BinaryDir)) &&
+                fs::exists(d / name))
+                return true;
+        }
+        return false;
+    };
+
+    // count
+    std::map<String, size_t> counts;
+    Strings order;
+    for (auto &tu : tus)
+    {
+        std::set<String> seen;
+        for (auto &h : scanIncludes(tu))
+        {
+            if (!seen.insert(h).second)
+                continue;
+            if (counts[h]++ == 0)
+                order.push_back(h);
+        }
+    }
+    auto freq = [&counts, &tus](const String &h)
+    {
+        auto i = counts.find(h);
+        return i == counts.end() ? 0.0 : (double)i->second / tus.size();
+    };
+
+    // previous selection, empty selection is a selection too
+    auto fn = BinaryDir.parent_path() / "pch" / "auto_pch.txt";
+    std::optional<std::set<String>> prev;
+    if (fs::exists(fn))
+    {
+        prev.emplace();
+        for (auto &l : split_lines(read_file(fn)))
+            prev->insert(l);
+    }
+
+    Strings selected;
+    for (auto &h : order)
+    {
+        auto f = freq(h);
+        if (!prev ? f < select_threshold : (prev->contains(h) ? f < keep_threshold : f < add_threshold))
+            continue;
+        if (is_own_header(h))
+            continue;
+        selected.push_back(h);
+    }
+
+    String s;
+    for (auto &h : selected)
+    {
+        s += h + "\n";
+        getMergeObject().PrecompiledHeaders.insert(h);
+    }
+    write_file_if_different(fn, s);
+}
+
 void NativeCompiledTarget::createPrecompiledHeader()
 {
     // disabled with PP
     if (PreprocessStep)
         return;
 
+    if (AutoPrecompiledHeader && getMergeObject().PrecompiledHeaders.empty())
+        detectPrecompiledHeader();
+
     auto &files = getMergeObject().PrecompiledHeaders;
     if (files.empty())
         return;
@@ -998,22 +1138,10 @@ void NativeCompiledTarget::findSources()
         if (bfn.empty())
             throw SW_RUNTIME_ERROR("No bazel file found in SourceDir: " + to_string(normalize_path(SourceDir)));
 
+        // same BUILD file is often shared between dozens of targets,
+        // so parse it once per process and keep parsed result on disk
         auto b = read_file(bfn);
-        auto f = bazel::parse(b);
-
-        /*static std::mutex m;
-        static std::unordered_map<String, bazel::File> files;
-        auto h = sha1(b);
-        auto i = files.find(h);
-        bazel::File *f = nullptr;
-        if (i == files.end())
-        {
-            std::unique_lock lk(m);
-            files[h] = bazel::parse(b);
-            f = &files[h];
-        }
-        else
-            f = &i->second;*/
+        const auto &f = bazel::parse(b, getContext().getLocalStorage().storage_dir_tmp / "db" / "bazel");
 
         String project_name;
         if (!getPackage().getPath().empty())
@@ -1069,7 +1197,7 @@ void NativeCompiledTarget::autoDetectSources()
         if (fs::exists(SourceDir / d))
         {
             // add files for non building
-            remove(FileRegex(d, std::regex(files_regex), true));
+            remove(FileRegex(d, String(files_regex), true));
             added = true;
             break; // break here!
         }
@@ -1079,7 +1207,7 @@ void NativeCompiledTarget::autoDetectSources()
         if (fs::exists(SourceDir / d))
         {
             // if build dir is "" or "." we do not do recursive search
-            add(FileRegex(d, std::regex(files_regex), d != ""s));
+            add(FileRegex(d, String(files_regex), d != ""s));
             added = true;
             break; // break here!
         }
@@ -1114,12 +1242,13 @@ void NativeCompiledTarget::autoDetectSources()
             return source_file_extensions;
         }();
 
+        // string regexes get fast matchers
         for (auto &v : getCppHeaderFileExtensions())
-            add(FileRegex(std::regex(".*\\" + escape_regex_symbols(v)), false));
+            add(FileRegex(".*\\" + escape_regex_symbols(v), false));
         for (auto &v : source_file_extensions)
-            add(FileRegex(std::regex(".*\\" + escape_regex_symbols(v)), false));
+            add(FileRegex(".*\\" + escape_regex_symbols(v), false));
         for (auto &v : other_source_file_extensions)
-            add(FileRegex(std::regex(".*\\" + escape_regex_symbols(v)), false));
+            add(FileRegex(".*\\" + escape_regex_symbols(v), false));
     }
 
     // erase config file, add a condition to not perform this code
@@ -55,8 +55,15 @@ public:
     // https://cmake.org/cmake/help/latest/prop_tgt/UNITY_BUILD.html
     // maybe implement source code before and after?
     bool UnityBuild = false;
+    // files are balanced between batches by estimated compile time
+    // 0 - automatic number of batches, depends on number of build jobs
     int UnityBuildBatchSize = 8;
 
+    // pch is generated from system and dependency headers
+    // included by most of translation units
+    // used only when no pch is set explicitly
+    bool AutoPrecompiledHeader = false;
+
     //
     bool PreprocessStep = false;
 
@@ -202,6 +209,7 @@ private:
     const TargetSettings &getInterfaceSettings() const override;
 
     void createPrecompiledHeader();
+    void detectPrecompiledHeader();
 
     //std::unique_ptr<NativeCompiler> prog_cl_cpp;
     //std::unique_ptr<NativeCompiler> prog_cl_c;
@@ -17,7 +17,11 @@ namespace sw
 {
 
 SwManagerContext::SwManagerContext(const path &local_storage_root_dir, bool allow_network)
+    : allow_network(allow_network)
 {
+    // no reallocations when remotes are added later
+    storages.reserve(2 + Settings::get_user_settings().getRemotes(allow_network).size());
+
     // first goes resolve cache
     cache_storage_id = storages.size();
     storages.emplace_back(std::make_unique<CachedStorage>());
@@ -25,15 +29,24 @@ SwManagerContext::SwManagerContext(const path &local_storage_root_dir, bool allo
     local_storage_id = storages.size();
     storages.emplace_back(std::make_unique<LocalStorage>(local_storage_root_dir));
 
+    // remotes go after, see initRemoteStorages()
     first_remote_storage_id = storages.size();
-    for (auto &r : Settings::get_user_settings().getRemotes(allow_network))
+}
+
+void SwManagerContext::initRemoteStorages() const
+{
+    std::call_once(remotes_flag, [this]
     {
-        if (r->isDisabled())
-            continue;
-        storages.emplace_back(
-            std::make_unique<RemoteStorageWithFallbackToRemoteResolving>(
-                getLocalStorage(), *r, allow_network));
-    }
+        auto &ls = static_cast<LocalStorage &>(*storages[local_storage_id]);
+        for (auto &r : Settings::get_user_settings().getRemotes(allow_network))
+        {
+            if (r->isDisabled())
+                continue;
+            storages.emplace_back(
+                std::make_unique<RemoteStorageWithFallbackToRemoteResolving>(
+                    ls, *r, allow_network));
+        }
+    });
 }
 
 SwManagerContext::~SwManagerContext() = default;
@@ -55,6 +68,7 @@ const LocalStorage &SwManagerContext::getLocalStorage() const
 
 std::vector<IStorage *> SwManagerContext::getRemoteStorages() const
 {
+    initRemoteStorages();
     std::vector<IStorage *> r;
     for (int i = first_remote_storage_id; i < storages.size(); i++)
         r.push_back(storages[i].get());
@@ -66,6 +80,15 @@ ResolveResultWithDependencies SwManagerContext::resolve(const UnresolvedPackages
     if (in_pkgs.empty())
         return {};
 
+    // everything may be known already (e.g. from lock file)
+    if (use_cache)
+    {
+        ResolveResultWithDependencies r;
+        if (tryResolve(in_pkgs, { storages[cache_storage_id].get() }, r, false))
+            return r;
+    }
+
+    initRemoteStorages();
     std::vector<IStorage *> s2;
     for (const auto &[i, s] : enumerate(storages))
     {
@@ -76,10 +99,17 @@ ResolveResultWithDependencies SwManagerContext::resolve(const UnresolvedPackages
 }
 
 ResolveResultWithDependencies SwManagerContext::resolve(const UnresolvedPackages &in_pkgs, const std::vector<IStorage*> &storages) const
+{
+    ResolveResultWithDependencies resolved;
+    tryResolve(in_pkgs, storages, resolved, true);
+    return resolved;
+}
+
+bool SwManagerContext::tryResolve(const UnresolvedPackages &in_pkgs, const std::vector<IStorage*> &storages,
+    ResolveResultWithDependencies &resolved, bool throw_on_missing) const
 {
     std::lock_guard lk(resolve_mutex);
 
-    ResolveResultWithDependencies resolved;
     auto upkgs = in_pkgs;
     while (1)
     {
@@ -118,7 +148,11 @@ ResolveResultWithDependencies SwManagerContext::resolve(const UnresolvedPackages
                 }
             }
             if (!pkg)
+            {
+                if (!throw_on_missing)
+                    return false;
                 throw SW_RUNTIME_ERROR("Package '" + p.toString() + "' is not resolved");
+            }
 
             resolved_step[p] = std::move(pkg);
         }
@@ -137,7 +171,7 @@ ResolveResultWithDependencies SwManagerContext::resolve(const UnresolvedPackages
     // save existing results
     getCachedStorage().storePackages(resolved.m);
 
-    return resolved;
+    return true;
 }
 
 std::unordered_map<UnresolvedPackage, LocalPackage> SwManagerContext::install(const UnresolvedPackages &pkgs, bool use_cache) const
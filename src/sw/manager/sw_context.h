@@ -51,10 +51,16 @@ private:
     int cache_storage_id;
     int local_storage_id;
     int first_remote_storage_id;
-    std::vector<std::unique_ptr<IStorage>> storages;
+    mutable std::vector<std::unique_ptr<IStorage>> storages;
     mutable std::mutex resolve_mutex;
+    bool allow_network;
+    mutable std::once_flag remotes_flag;
 
     CachedStorage &getCachedStorage() const;
+    /// remote databases are opened (and refreshed) only when really needed
+    void initRemoteStorages() const;
+    /// returns false on unresolved packages if throw_on_missing is not set
+    bool tryResolve(const UnresolvedPackages &, const std::vector<IStorage*> &, ResolveResultWithDependencies &, bool throw_on_missing) const;
 };
 
 } // namespace sw
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+// Synthetic build graphs for measuring builder core overhead.
+// Runs offline, prints json results.
+
+#include <sw/builder/command.h>
+#include <sw/builder/command_storage.h>
+#include <sw/builder/execution_plan.h>
+#include <sw/builder/file.h>
+#include <sw/builder/file_storage.h>
+#include <sw/builder/sw_context.h>
+
+#include <nlohmann/json.hpp>
+#include <primitives/executor.h>
+#include <primitives/sw/main.h>
+#include <primitives/sw/cl.h>
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <set>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "builder.bench");
+
+using namespace sw;
+
+using Clock = std::chrono::steady_clock;
+
+static int bench_touch(path out)
+{
+    write_file(out, "");
+    return 0;
+}
+
+struct Graph
+{
+    String shape;
+    // command -> its deps
+    std::vector<std::vector<size_t>> deps;
+    size_t edges = 0;
+
+    void add(std::vector<size_t> d = {})
+    {
+        edges += d.size();
+        deps.push_back(std::move(d));
+    }
+};
+
+static Graph make_wide(size_t n)
+{
+    Graph g{ "wide" };
+    for (size_t i = 0; i < n; i++)
+        g.add();
+    return g;
+}
+
+static Graph make_deep(size_t n, size_t depth)
+{
+    Graph g{ "deep" };
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i % depth == 0)
+            g.add();
+        else
+            g.add({ i - 1 });
+    }
+    return g;
+}
+
+// layers, every node depends on two neighbours from the previous layer
+static Graph make_diamond(size_t n)
+{
+    Graph g{ "diamond" };
+    size_t w = std::max<size_t>(2, (size_t)std::sqrt((double)n));
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i < w)
+        {
+            g.add();
+            continue;
+        }
+        auto prev = i - i % w - w;
+        g.add({ prev + i % w, prev + (i + 1) % w });
+    }
+    return g;
+}
+
+// targets: some compiles and a link depending on them and on a few earlier links
+static Graph make_realistic(size_t n)
+{
+    Graph g{ "realistic" };
+    std::mt19937_64 rng(42);
+    std::vector<size_t> links;
+    while (g.deps.size() < n)
+    {
+        auto ncompiles = std::min<size_t>(5 + rng() % 100, n - g.deps.size());
+        std::vector<size_t> objs;
+        for (size_t i = 0; i < ncompiles; i++)
+        {
+            objs.push_back(g.deps.size());
+            g.add();
+        }
+        if (g.deps.size() == n)
+            break;
+        std::set<size_t> ldeps;
+        for (int i = 0, ndeps = links.empty() ? 0 : (int)(rng() % 4); i < ndeps; i++)
+            ldeps.insert(links[rng() % links.size()]);
+        objs.insert(objs.end(), ldeps.begin(), ldeps.end());
+        links.push_back(g.deps.size());
+        g.add(objs);
+    }
+    return g;
+}
+
+static Commands create_commands(const SwBuilderContext &swctx, const Graph &g, const path &dir, bool process, bool lightweight)
+{
+    auto &cs = swctx.getCommandStorage(dir / "cs");
+    auto out = [&dir](size_t i)
+    {
+        return dir / "out" / std::to_string(i % 256) / std::to_string(i);
+    };
+
+    Commands cmds;
+    cmds.reserve(g.deps.size());
+    for (size_t i = 0; i < g.deps.size(); i++)
+    {
+        std::shared_ptr<builder::Command> c;
+        if (process)
+        {
+            c = std::make_shared<builder::Command>(swctx);
+            c->setProgram("touch");
+            c->push_back(out(i));
+        }
+        else
+        {
+            auto bc = std::make_shared<BuiltinCommand>(swctx, "sw_bench_touch", (void*)&bench_touch);
+            bc->setFunction(bench_touch, out(i));
+            // builtins go to the lightweight executor, which ignores -j
+            bc->lightweight = lightweight;
+            c = bc;
+        }
+        c->name = "cmd " + std::to_string(i);
+        c->command_storage = &cs;
+        c->addOutput(out(i));
+        for (auto d : g.deps[i])
+            c->addInput(out(d));
+        cmds.insert(c);
+    }
+    return cmds;
+}
+
+template <class F>
+static void measure(nlohmann::json &j, const String &name, F &&f)
+{
+    auto t0 = Clock::now();
+    f();
+    auto t = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count() / 1000.0;
+    j[name + "_ms"] = t;
+    LOG_INFO(logger, "    " << name << ": " << t << " ms");
+}
+
+static nlohmann::json run(const Graph &g, const path &dir, Executor &e, bool process, bool lightweight)
+{
+    LOG_INFO(logger, g.shape << ": " << g.deps.size() << " commands, " << g.edges << " edges");
+
+    error_code ec;
+    fs::remove_all(dir, ec);
+    for (int i = 0; i < 256; i++)
+        fs::create_directories(dir / "out" / std::to_string(i));
+
+    nlohmann::json j;
+    j["shape"] = g.shape;
+    j["commands"] = g.deps.size();
+    j["edges"] = g.edges;
+    auto &p = j["phases"];
+
+    auto build = [&](const String &prefix)
+    {
+        auto swctx = std::make_unique<SwBuilderContext>();
+        Commands cmds;
+        measure(p, prefix + "create", [&] { cmds = create_commands(*swctx, g, dir, process, lightweight); });
+        std::unique_ptr<ExecutionPlan> ep;
+        measure(p, prefix + "plan_init", [&] { ep = ExecutionPlan::create(cmds); });
+        ep->silent = true;
+        measure(p, prefix + "execute", [&] { ep->execute(e); });
+        return std::tuple{ std::move(swctx), std::move(cmds) };
+    };
+
+    // everything is outdated
+    auto r = build("full_");
+    auto &swctx = std::get<0>(r);
+    auto &cmds = std::get<1>(r);
+
+    // file storage refresh
+    {
+        auto &fstorage = swctx->getFileStorage();
+        measure(p, "fs_refresh", [&]
+        {
+            fstorage.reset();
+            for (auto &c : cmds)
+            {
+                for (auto &o : c->outputs)
+                    File(o, fstorage).isChanged();
+            }
+        });
+    }
+
+    cmds.clear();
+    measure(p, "cs_save", [&] { swctx->clearCommandStorages(); });
+    swctx.reset();
+
+    {
+        SwBuilderContext swctx;
+        measure(p, "cs_load", [&] { swctx.getCommandStorage(dir / "cs"); });
+    }
+
+    // nothing is outdated
+    build("noop_");
+
+    return j;
+}
+
+int main(int argc, char **argv)
+{
+    static cl::opt<String> loglevel("log-level", cl::init("INFO"));
+    static cl::opt<path> dir("dir", cl::desc("Working dir"), cl::init(fs::temp_directory_path() / "sw_builder_bench"));
+    static cl::opt<path> output("output", cl::desc("Write json results to file instead of stdout"));
+    static cl::list<String> shapes("shape", cl::desc("wide, deep, diamond, realistic"), cl::CommaSeparated);
+    static cl::opt<int> n("commands", cl::desc("Number of commands per graph"), cl::init(100'000));
+    static cl::opt<int> depth("depth", cl::desc("Chain length for deep graphs"), cl::init(1000));
+    static cl::opt<int> jobs("j", cl::desc("Number of jobs"), cl::init(0));
+    static cl::opt<bool> process("process", cl::desc("Spawn 'touch' processes instead of builtin commands"));
+    static cl::opt<bool> lightweight("lightweight", cl::desc("Run builtin commands on the lightweight executor as real builds do, -j is not used then"));
+
+    cl::ParseCommandLineOptions(argc, argv);
+
+    LoggerSettings log_settings;
+    log_settings.log_level = loglevel;
+    log_settings.simple_logger = true;
+    initLogger(log_settings);
+
+    Executor e(jobs > 0 ? jobs : select_number_of_threads());
+
+    Strings selected(shapes.begin(), shapes.end());
+    if (selected.empty())
+        selected = { "wide", "deep", "diamond", "realistic" };
+
+    nlohmann::json j;
+    j["version"] = 1;
+    j["jobs"] = e.numberOfThreads();
+    j["process"] = (bool)process;
+    j["lightweight"] = !process && lightweight;
+    for (auto &s : selected)
+    {
+        Graph g;
+        if (s == "wide")
+            g = make_wide(n);
+        else if (s == "deep")
+            g = make_deep(n, std::max(depth.getValue(), 1));
+        else if (s == "diamond")
+            g = make_diamond(n);
+        else if (s == "realistic")
+            g = make_realistic(n);
+        else
+            throw SW_RUNTIME_ERROR("Unknown shape: " + s);
+        j["results"].push_back(run(g, dir / s, e, process, lightweight));
+    }
+
+    error_code ec;
+    fs::remove_all(dir, ec);
+
+    if (output.empty())
+        std::cout << j.dump(2) << "\n";
+    else
+        write_file(output, j.dump(2));
+    return 0;
+}
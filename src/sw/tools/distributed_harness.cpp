@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
+
+// Runs distributed build server and several workers on localhost
+// and checks routing, blob transfer, plans and local fallback.
+
+#include <sw/builder_distributed/client.h>
+#include <sw/builder_distributed/server.h>
+#include <sw/builder_distributed/worker.h>
+
+#include <boost/algorithm/string.hpp>
+#include <primitives/executor.h>
+#include <primitives/sw/main.h>
+#include <primitives/sw/cl.h>
+
+#include <map>
+#include <thread>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "builder.distributed.harness");
+
+using namespace sw::builder::distributed;
+
+static String localhost(int port)
+{
+    return "127.0.0.1:" + std::to_string(port);
+}
+
+struct Stats
+{
+    std::mutex m;
+    std::map<String, int> by_worker;
+    int failed = 0;
+
+    void add(const String &w, bool ok)
+    {
+        std::unique_lock lk(m);
+        by_worker[w.empty() ? "server" : "worker " + w]++;
+        failed += !ok;
+    }
+};
+
+// uppercases input file into output file
+static void run(Client &c, const path &dir, int i, Stats &s)
+{
+    auto in = dir / "src" / (std::to_string(i) + ".txt");
+    auto out = dir / "out" / (std::to_string(i) + ".txt");
+    auto text = "command " + std::to_string(i) + " input";
+    write_file(in, text);
+    error_code ec;
+    fs::remove(out, ec);
+
+    ::sw::api::build::Command request;
+    request.add_arguments("sh");
+    request.add_arguments("-c");
+    request.add_arguments("tr a-z A-Z < \"$0\" > \"$1\"");
+    request.add_arguments(to_string(normalize_path(in)));
+    request.add_arguments(to_string(normalize_path(out)));
+    request.set_working_directory(to_string(normalize_path(dir)));
+    request.add_outputs(to_string(normalize_path(out)));
+    *request.add_inputs() = c.getStore().addFile(in);
+
+    ::sw::api::build::CommandResult response;
+    c.execute(request, response);
+
+    auto ok = response.exit_code() == 0
+        && response.outputs().size() == 1
+        && response.outputs(0).hash() == BlobStore::getHash(boost::to_upper_copy(text))
+        && read_file(out) == boost::to_upper_copy(text);
+    if (!ok)
+        LOG_ERROR(logger, "Command " << i << " failed: " << response.err());
+    s.add(response.worker(), ok);
+}
+
+static int run_all(Client &c, const path &dir, int n, Executor &e, const String &name)
+{
+    Stats s;
+    std::vector<Future<void>> fs;
+    for (int i = 0; i < n; i++)
+        fs.push_back(e.push([&c, &dir, i, &s] { run(c, dir, i, s); }));
+    waitAndGet(fs);
+    LOG_INFO(logger, name << ": " << n << " commands, " << s.failed << " failed");
+    for (auto &[w, cnt] : s.by_worker)
+        LOG_INFO(logger, "    " << w << ": " << cnt);
+    return s.failed;
+}
+
+static ::sw::api::build::Command make_command(const String &script, const path &in, const path &out)
+{
+    ::sw::api::build::Command c;
+    c.add_arguments("sh");
+    c.add_arguments("-c");
+    c.add_arguments(script);
+    c.add_arguments(to_string(normalize_path(in)));
+    c.add_arguments(to_string(normalize_path(out)));
+    c.add_outputs(to_string(normalize_path(out)));
+    return c;
+}
+
+// pairs of commands, second one uses output of the first
+static ::sw::api::build::Plan make_plan(Client &c, const path &dir, int n)
+{
+    ::sw::api::build::Plan p;
+    p.set_id("plan");
+    for (int i = 0; i < n; i++)
+    {
+        auto in = dir / "plan" / (std::to_string(i) + ".txt");
+        auto mid = dir / "plan" / (std::to_string(i) + ".upper");
+        auto out = dir / "plan" / (std::to_string(i) + ".out");
+        write_file(in, "plan input " + std::to_string(i));
+
+        auto a = p.add_commands();
+        a->set_id(i * 2);
+        *a->mutable_command() = make_command("tr a-z A-Z < \"$0\" > \"$1\"", in, mid);
+        *a->mutable_command()->add_inputs() = c.getStore().addFile(in);
+
+        auto b = p.add_commands();
+        b->set_id(i * 2 + 1);
+        *b->mutable_command() = make_command("rev < \"$0\" > \"$1\"", mid, out);
+        b->add_dependencies(i * 2);
+        b->mutable_command()->add_inputs()->set_path(to_string(normalize_path(mid))); // produced by the plan
+    }
+    return p;
+}
+
+static int run_plan(Client &c, const path &dir, int n)
+{
+    int failed = 0;
+    auto check = [&failed](const String &name, bool ok)
+    {
+        LOG_INFO(logger, name << ": " << (ok ? "ok" : "failed"));
+        failed += !ok;
+    };
+
+    auto p = make_plan(c, dir, n);
+    int executed = 0;
+    c.execute(p, [&executed](auto &r) { executed += !r.skipped() && r.result().exit_code() == 0; });
+    bool ok = executed == n * 2;
+    for (int i = 0; i < n; i++)
+    {
+        auto s = "PLAN INPUT " + std::to_string(i);
+        ok &= read_file(dir / "plan" / (std::to_string(i) + ".out")) == String(s.rbegin(), s.rend());
+    }
+    check("plan", ok);
+
+    // first commands are done, their outputs are known now
+    for (auto &pc : *p.mutable_commands())
+    {
+        if (pc.id() % 2 == 0)
+            p.add_completed(pc.id());
+        else
+            *pc.mutable_command()->mutable_inputs(0) = c.getStore().addFile(fs::u8path(pc.command().inputs(0).path()));
+    }
+    executed = 0;
+    c.execute(p, [&executed](auto &r) { executed += r.id() % 2 && !r.skipped(); });
+    check("partial resubmission", executed == n);
+
+    // failed command skips its dependents
+    p.clear_completed();
+    *p.mutable_commands(0)->mutable_command() = make_command("exit 1", {}, dir / "plan" / "none");
+    int skipped = 0;
+    c.execute(p, [&skipped](auto &r) { skipped += r.skipped(); });
+    check("failure", skipped == 1);
+
+    // long chain, cancelled in the middle
+    ::sw::api::build::Plan chain;
+    chain.set_id("chain");
+    for (int i = 0; i < 20; i++)
+    {
+        auto pc = chain.add_commands();
+        pc->set_id(i);
+        *pc->mutable_command() = make_command("sleep 0.1", {}, dir / "plan" / "none");
+        if (i)
+            pc->add_dependencies(i - 1);
+    }
+    skipped = 0;
+    std::thread t([&c]
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        c.cancel("chain");
+    });
+    c.execute(chain, [&skipped](auto &r) { skipped += r.skipped(); });
+    t.join();
+    check("cancel", skipped > 0 && skipped < 20);
+
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    static cl::opt<String> loglevel("log-level", cl::init("INFO"));
+    static cl::opt<path> dir("dir", cl::desc("Working dir"), cl::init(fs::temp_directory_path() / "sw_distributed_harness"));
+    static cl::opt<int> n_workers("workers", cl::desc("Number of workers"), cl::init(3));
+    static cl::opt<int> capacity("capacity", cl::desc("Capacity of every worker"), cl::init(2));
+    static cl::opt<int> n("commands", cl::desc("Number of commands per stage"), cl::init(100));
+
+    cl::ParseCommandLineOptions(argc, argv);
+
+    LoggerSettings log_settings;
+    log_settings.log_level = loglevel;
+    log_settings.simple_logger = true;
+    initLogger(log_settings);
+
+    error_code ec;
+    fs::remove_all(dir, ec);
+
+    // separate storages, so blobs are really transferred
+    Server server(dir / "server");
+    auto port = server.start(localhost(0));
+
+    std::vector<std::unique_ptr<WorkerServer>> workers;
+    for (int i = 0; i < n_workers; i++)
+    {
+        auto &w = workers.emplace_back(std::make_unique<WorkerServer>(dir / ("worker" + std::to_string(i)), capacity));
+        auto wport = w->start(localhost(0));
+        w->registerOn(localhost(port), localhost(wport));
+    }
+
+    Client client(localhost(port), dir / "client");
+    Executor e(n_workers * capacity * 2);
+    int failed = 0;
+
+    failed += run_all(client, dir, n, e, "workers");
+
+    // plans go through in-process channel
+    Client plan_client(server.getInProcessChannel(), dir / "client");
+    failed += run_plan(plan_client, dir, n);
+
+    // calls to unreachable worker fail, commands go to others
+    ::sw::api::build::WorkerInfo bad;
+    bad.set_endpoint(localhost(1));
+    bad.set_capacity(capacity * 4);
+    server.registerWorker(bad);
+    failed += run_all(client, dir, n, e, "unreachable worker");
+
+    // no workers, the server executes commands itself
+    for (auto &w : workers)
+        w->stop();
+    workers.clear();
+    failed += run_all(client, dir, n, e, "no workers");
+    if (server.getNumberOfWorkers())
+    {
+        LOG_ERROR(logger, "Workers were not unregistered: " << server.getNumberOfWorkers());
+        failed++;
+    }
+
+    server.stop();
+    fs::remove_all(dir, ec);
+
+    LOG_INFO(logger, (failed ? "FAILED" : "OK"));
+    return failed ? 1 : 0;
+}
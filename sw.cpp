@@ -360,6 +360,26 @@ void build(Solution &s)
         add_build_test_with_configs("cpp/pch");
     }
 
+    // benchmarks
+    {
+        auto &bench = builder.addTarget<ExecutableTarget>("bench");
+        bench.PackageDefinitions = true;
+        bench += cpp20;
+        bench += "src/sw/tools/builder_bench.cpp";
+        bench += builder;
+        bench += "pub.egorpugin.primitives.sw.main-master"_dep;
+    }
+
+    // localhost distributed build check
+    {
+        auto &harness = builder.addTarget<ExecutableTarget>("distributed_harness");
+        harness.PackageDefinitions = true;
+        harness += cpp20;
+        harness += "src/sw/tools/distributed_harness.cpp";
+        harness += builder_distributed;
+        harness += "pub.egorpugin.primitives.sw.main-master"_dep;
+    }
+
     auto &sp = sw.addProject("server");
     auto &mirror = sp.addTarget<ExecutableTarget>("mirror");
     {
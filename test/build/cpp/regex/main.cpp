@@ -0,0 +1,9 @@
+int a();
+int b();
+int n();
+int gen1();
+
+int main()
+{
+    return a() + b() + n() + gen1() == 7 ? 0 : 1;
+}
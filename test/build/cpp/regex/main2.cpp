@@ -0,0 +1,7 @@
+int gen1();
+int gen2();
+
+int main()
+{
+    return gen1() + gen2() == 3 ? 0 : 1;
+}
@@ -0,0 +1 @@
+#error non recursive regex must not go into subdirs
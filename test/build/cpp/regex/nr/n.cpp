@@ -0,0 +1 @@
+int n() { return 3; }
@@ -0,0 +1 @@
+#error files starting with _ must not match
@@ -0,0 +1,26 @@
+void build(Solution &s)
+{
+    auto &t = s.addExecutable("regex");
+    t += "main\\.cpp"_r;
+    // non recursive: nr/deep is not listed
+    t += "nr/.*\\.cpp"_r;
+    // recursive with a class: src/_bad.cpp is not matched, src/sub/b.cpp is
+    t += "src/[^_].*\\.cpp"_rr;
+    // excluded dir
+    t ^= "src/broken/.*"_rr;
+
+    // the listing of gen is cached here
+    auto gen = t.BinaryDir / "gen";
+    fs::remove_all(gen);
+    fs::create_directories(gen);
+    write_file(gen / "1.cpp", "int gen1() { return 1; }\n");
+    t += FileRegex(gen, ".*\\.cpp", true);
+
+    // and must be refreshed after a file is added
+    write_file(gen / "2.cpp", "int gen2() { return 2; }\n");
+    // dir mtime is coarse, make sure it is changed
+    fs::last_write_time(gen, fs::last_write_time(gen) + std::chrono::seconds(1));
+    auto &t2 = s.addExecutable("regex2");
+    t2 += "main2.cpp";
+    t2 += FileRegex(gen, ".*\\.cpp", true);
+}
@@ -0,0 +1,110 @@
+#include <sw/builder/command.h>
+#include <sw/builder/command_storage.h>
+#include <sw/builder/execution_plan.h>
+#include <sw/builder/file_storage.h>
+#include <sw/builder/sw_context.h>
+
+#include <primitives/filesystem.h>
+
+#include <chrono>
+#include <iostream>
+
+#define CATCH_CONFIG_RUNNER
+#include <catch2/catch.hpp>
+
+using namespace sw;
+
+static Strings args(const builder::Command &c)
+{
+    Strings s;
+    for (auto &a : c.getArguments())
+        s.push_back(a->toString());
+    return s;
+}
+
+TEST_CASE("Execution plan round trip", "[explan]")
+{
+    auto dir = fs::absolute(fs::temp_directory_path() / "sw_test_explan");
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    ScopedCurrentPath scp(dir, CurrentPathScope::All);
+
+    SwBuilderContext swctx;
+    auto &cs = swctx.getCommandStorage(dir / "cs");
+
+    auto prog = dir / "prog";
+    auto in = dir / "in.txt";
+    auto out = dir / "out.txt";
+    write_file(prog, "");
+    write_file(in, "");
+    write_file(out, "");
+
+    auto c = std::make_shared<builder::Command>(swctx);
+    c->name = "round trip";
+    c->setProgram(prog);
+    c->push_back("-o");
+    c->push_back(out);
+    c->push_back(in);
+    c->use_response_files = true;
+    c->first_response_file_argument = 1;
+    c->deps_processor = builder::Command::DepsProcessor::Gnu;
+    c->deps_file = dir / "out.d";
+    c->environment["SW_TEST_VAR"] = "1";
+    c->strict_order = 3;
+    c->addInput(in);
+    c->addOutput(out);
+    c->command_storage = &cs;
+
+    auto plan = dir / "plan.swep";
+    {
+        Commands cmds{ c };
+        ExecutionPlan::create(cmds)->save(plan);
+    }
+
+    auto cmds = ExecutionPlan::load(plan, swctx);
+    REQUIRE(cmds.size() == 1);
+    auto l = *cmds.begin();
+
+    // plan part, details are not loaded yet
+    REQUIRE(l->getHash() == c->getHash());
+    REQUIRE(l->strict_order == c->strict_order);
+    REQUIRE(l->command_storage == c->command_storage);
+    REQUIRE(l->inputs == c->inputs);
+    REQUIRE(l->outputs == c->outputs);
+
+    SECTION("up to date")
+    {
+        auto &r = *cs.insert(c->getHash()).first;
+        r.mtime = std::max(fs::last_write_time(in), fs::last_write_time(out));
+        REQUIRE_FALSE(c->isOutdated());
+        REQUIRE_FALSE(l->isOutdated());
+    }
+
+    SECTION("outdated")
+    {
+        auto &r = *cs.insert(c->getHash()).first;
+        r.mtime = std::max(fs::last_write_time(in), fs::last_write_time(out));
+        fs::last_write_time(in, r.mtime + std::chrono::seconds(10));
+        swctx.getFileStorage().reset();
+        REQUIRE(c->isOutdated());
+        REQUIRE(l->isOutdated());
+    }
+
+    // details
+    REQUIRE(l->getName() == c->getName());
+    REQUIRE(l->getProgram() == c->getProgram());
+    REQUIRE(args(*l) == args(*c));
+    REQUIRE(l->use_response_files == c->use_response_files);
+    REQUIRE(l->first_response_file_argument == c->first_response_file_argument);
+    REQUIRE(l->needsResponseFile() == c->needsResponseFile());
+    REQUIRE(l->deps_processor == c->deps_processor);
+    REQUIRE(l->deps_file == c->deps_file);
+    REQUIRE(l->environment == c->environment);
+}
+
+int main(int argc, char **argv)
+{
+    Catch::Session().run(argc, argv);
+
+    return 0;
+}